@@ -0,0 +1,616 @@
+// Micro-benchmarks for the obj2las hot loops. All inputs are synthetic so the
+// benchmarks run without sample data:
+//   ./build/obj2las_bench            run every benchmark
+//   ./build/obj2las_bench sampling   run only the named benchmark
+#include "include/colors.h"
+#include "include/color_stats.h"
+#include "include/sampling.h"
+#include "include/texture.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static double secondsSince(const std::chrono::high_resolution_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static Texture makeSyntheticTexture(int width, int height) {
+    Texture texture;
+    texture.width = width;
+    texture.height = height;
+    texture.channels = 3;
+    texture.data.resize(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t index = (static_cast<size_t>(y) * width + x) * 3;
+            texture.data[index + 0] = static_cast<unsigned char>(x * 7);
+            texture.data[index + 1] = static_cast<unsigned char>(y * 3);
+            texture.data[index + 2] = static_cast<unsigned char>(x ^ y);
+        }
+    }
+    return texture;
+}
+
+// Regular grid of quads with UVs spanning [0, 1], as the OBJ loader would
+// return it; buildTriangleMesh splits every quad into two triangles
+static void makeSyntheticObj(int cells, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes) {
+    for (int j = 0; j <= cells; j++) {
+        for (int i = 0; i <= cells; i++) {
+            attrib.vertices.push_back(i);
+            attrib.vertices.push_back(j);
+            attrib.vertices.push_back(static_cast<float>((i * j) % 7) * 0.01f);
+            attrib.texcoords.push_back(static_cast<double>(i) / cells);
+            attrib.texcoords.push_back(static_cast<double>(j) / cells);
+        }
+    }
+    shapes.resize(1);
+    tinyobj::mesh_t& mesh = shapes[0].mesh;
+    auto corner = [&](int i, int j) {
+        tinyobj::index_t idx;
+        idx.vertex_index = idx.texcoord_index = j * (cells + 1) + i;
+        idx.normal_index = -1;
+        mesh.indices.push_back(idx);
+    };
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            corner(i, j); corner(i + 1, j); corner(i + 1, j + 1); corner(i, j + 1);
+            mesh.num_face_vertices.push_back(4);
+            mesh.material_ids.push_back(0);
+        }
+    }
+}
+
+// Triangles of buildTriangleMesh that disagree with a fan walk over the
+// face indices
+static size_t countTriangleMeshMismatches(const TriangleMesh& mesh, const tinyobj::attrib_t& attrib,
+                                          const std::vector<tinyobj::shape_t>& shapes) {
+    size_t mismatches = 0, t = 0;
+    for (const auto& shape : shapes) {
+        size_t indexOffset = 0;
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            size_t fv = shape.mesh.num_face_vertices[f];
+            for (size_t k = 1; k + 1 < fv; k++, t++) {
+                if (t >= mesh.triangleCount()) {
+                    return mismatches + 1;
+                }
+                const size_t corners[3] = {indexOffset, indexOffset + k, indexOffset + k + 1};
+                bool same = mesh.materialIds[t] == shape.mesh.material_ids[f];
+                for (int c = 0; c < 3; c++) {
+                    const tinyobj::index_t& idx = shape.mesh.indices[corners[c]];
+                    const double* p = &attrib.vertices[3 * idx.vertex_index];
+                    const double* uv = &attrib.texcoords[2 * idx.texcoord_index];
+                    size_t corner = 3 * t + c;
+                    same = same && mesh.x[corner] == static_cast<float>(p[0] - mesh.origin[0]) &&
+                           mesh.y[corner] == static_cast<float>(p[1] - mesh.origin[1]) &&
+                           mesh.z[corner] == static_cast<float>(p[2] - mesh.origin[2]) &&
+                           mesh.u[corner] == static_cast<float>(uv[0]) && mesh.v[corner] == static_cast<float>(uv[1]);
+                }
+                mismatches += !same;
+            }
+            indexOffset += fv;
+        }
+    }
+    return mismatches + (t != mesh.triangleCount());
+}
+
+static void benchSampling() {
+    const size_t sampleCount = 1 << 22;
+    const int repeats = 5;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    makeSyntheticObj(512, attrib, shapes);
+    TriangleMesh mesh = buildTriangleMesh(attrib, shapes);
+    const size_t layoutMismatches = countTriangleMeshMismatches(mesh, attrib, shapes);
+    Texture texture = makeSyntheticTexture(4096, 4096);
+    std::vector<const Texture*> textures(1, &texture);
+
+    // Samples are generated per triangle, the way a surface sampler emits them
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<int32_t> triangles(sampleCount);
+    std::vector<float> baryU(sampleCount), baryV(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++) {
+        triangles[i] = static_cast<int32_t>((i / 16) % mesh.triangleCount());
+        float a = unit(rng), b = unit(rng);
+        if (a + b > 1.0f) {
+            a = 1.0f - a;
+            b = 1.0f - b;
+        }
+        baryU[i] = a;
+        baryV[i] = b;
+    }
+
+    std::vector<std::vector<float> > scalarOut(8, std::vector<float>(sampleCount));
+    std::vector<std::vector<float> > kernelOut(8, std::vector<float>(sampleCount));
+    SampleOutputs scalar = {scalarOut[0].data(), scalarOut[1].data(), scalarOut[2].data(), scalarOut[3].data(),
+                            scalarOut[4].data(), scalarOut[5].data(), scalarOut[6].data(), scalarOut[7].data()};
+    SampleOutputs kernel = {kernelOut[0].data(), kernelOut[1].data(), kernelOut[2].data(), kernelOut[3].data(),
+                            kernelOut[4].data(), kernelOut[5].data(), kernelOut[6].data(), kernelOut[7].data()};
+
+    double scalarBest = 1e30, kernelBest = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        interpolateSamplesScalar(mesh, textures, triangles.data(), baryU.data(), baryV.data(), sampleCount, scalar);
+        scalarBest = std::min(scalarBest, secondsSince(start));
+        start = std::chrono::high_resolution_clock::now();
+        interpolateSamples(mesh, textures, triangles.data(), baryU.data(), baryV.data(), sampleCount, kernel);
+        kernelBest = std::min(kernelBest, secondsSince(start));
+    }
+
+    size_t mismatches = 0;
+    for (size_t c = 0; c < scalarOut.size(); c++) {
+        mismatches += std::memcmp(scalarOut[c].data(), kernelOut[c].data(), sampleCount * sizeof(float)) != 0;
+    }
+    // The kernel must agree with the row-major results on tiled storage too
+    std::shared_ptr<Texture> tiled = convertTextureLayout(texture, TextureLayout::Tiled);
+    std::vector<const Texture*> tiledTextures(1, tiled.get());
+    interpolateSamples(mesh, tiledTextures, triangles.data(), baryU.data(), baryV.data(), sampleCount, kernel);
+    for (size_t c = 0; c < scalarOut.size(); c++) {
+        mismatches += std::memcmp(scalarOut[c].data(), kernelOut[c].data(), sampleCount * sizeof(float)) != 0;
+    }
+
+    std::cout << "sampling: " << sampleCount << " samples, " << mesh.triangleCount() << " triangles, 4096x4096 texture" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  scalar:              " << sampleCount / scalarBest / 1e6 << " M samples/s/core" << std::endl;
+    std::cout << "  kernel (" << (sampleKernelUsesAVX2() ? "avx2" : "scalar") << "):       "
+              << sampleCount / kernelBest / 1e6 << " M samples/s/core" << std::endl;
+    std::cout << "  triangle layout " << (layoutMismatches == 0 ? "matches face walk" : "DIFFERS from face walk")
+              << std::endl;
+    std::cout << "  outputs " << (mismatches == 0 ? "match" : "DIFFER") << std::endl;
+}
+
+// Grid mesh whose corners carry random UVs over several large textures,
+// the access pattern of a model textured from scattered atlas islands
+static void benchColorPass() {
+    const int cells = 700;
+    const int materialCount = 4;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes(1);
+    std::vector<tinyobj::material_t> materials(materialCount);
+    std::map<std::string, TexturePtr> textures;
+    for (int m = 0; m < materialCount; m++) {
+        materials[m].name = "material" + std::to_string(m);
+        materials[m].diffuse_texname = "atlas" + std::to_string(m) + ".jpg";
+        textures[materials[m].diffuse_texname] = std::make_shared<Texture>(makeSyntheticTexture(8192, 8192));
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int j = 0; j <= cells; j++) {
+        for (int i = 0; i <= cells; i++) {
+            attrib.vertices.push_back(i);
+            attrib.vertices.push_back(j);
+            attrib.vertices.push_back(0);
+        }
+    }
+    tinyobj::mesh_t& mesh = shapes[0].mesh;
+    auto corner = [&](int i, int j) {
+        tinyobj::index_t idx;
+        idx.vertex_index = j * (cells + 1) + i;
+        idx.normal_index = -1;
+        idx.texcoord_index = static_cast<int>(attrib.texcoords.size() / 2);
+        attrib.texcoords.push_back(unit(rng));
+        attrib.texcoords.push_back(unit(rng));
+        mesh.indices.push_back(idx);
+    };
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            int material = static_cast<int>(rng() % materialCount);
+            corner(i, j); corner(i + 1, j); corner(i + 1, j + 1);
+            corner(i, j); corner(i + 1, j + 1); corner(i, j + 1);
+            mesh.num_face_vertices.push_back(3);
+            mesh.num_face_vertices.push_back(3);
+            mesh.material_ids.push_back(material);
+            mesh.material_ids.push_back(material);
+        }
+    }
+
+    ColorPassOptions fileOrder;
+    fileOrder.threads = 1;
+    ColorPassOptions sorted;
+    sorted.sortedSampling = true;
+    sorted.threads = 1;
+    ColorPassOptions parallel;
+
+    // The color pass logs its progress, keep the benchmark output readable
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    std::ostringstream discard;
+    std::cout.rdbuf(discard.rdbuf());
+    double fileOrderBest = 1e30, sortedBest = 1e30, parallelBest = 1e30;
+    std::vector<Vec3> fileOrderColors, sortedColors, parallelColors;
+    for (int r = 0; r < 3; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fileOrderColors = computeVertexColorsFromTextures(attrib, shapes, materials, textures, fileOrder);
+        fileOrderBest = std::min(fileOrderBest, secondsSince(start));
+        start = std::chrono::high_resolution_clock::now();
+        sortedColors = computeVertexColorsFromTextures(attrib, shapes, materials, textures, sorted);
+        sortedBest = std::min(sortedBest, secondsSince(start));
+        start = std::chrono::high_resolution_clock::now();
+        parallelColors = computeVertexColorsFromTextures(attrib, shapes, materials, textures, parallel);
+        parallelBest = std::min(parallelBest, secondsSince(start));
+    }
+    std::cout.rdbuf(coutBuffer);
+
+    bool match = fileOrderColors.size() == sortedColors.size() &&
+                 std::memcmp(fileOrderColors.data(), sortedColors.data(), fileOrderColors.size() * sizeof(Vec3)) == 0 &&
+                 fileOrderColors.size() == parallelColors.size() &&
+                 std::memcmp(fileOrderColors.data(), parallelColors.data(), fileOrderColors.size() * sizeof(Vec3)) == 0;
+    size_t samples = mesh.indices.size();
+    std::cout << "color-pass: " << samples << " samples, " << materialCount << " textures of 8192x8192" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  file order:          " << fileOrderBest << " s (" << samples / fileOrderBest / 1e6 << " M samples/s)" << std::endl;
+    std::cout << "  texture/tile sorted: " << sortedBest << " s (" << samples / sortedBest / 1e6 << " M samples/s)" << std::endl;
+    std::cout << "  file order, " << std::thread::hardware_concurrency() << " threads: " << parallelBest << " s ("
+              << samples / parallelBest / 1e6 << " M samples/s)" << std::endl;
+    std::cout << "  colors " << (match ? "match" : "DIFFER") << std::endl;
+}
+
+// Sampling throughput of row-major vs tiled storage, for random lookups and for
+// coherent walks that run down the texture the way vertical UV islands do
+static void benchTextureLayout() {
+    const size_t sampleCount = 1 << 23;
+    Texture rowMajor = makeSyntheticTexture(8192, 8192);
+    std::shared_ptr<Texture> tiled = convertTextureLayout(rowMajor, TextureLayout::Tiled);
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> randomU(sampleCount), randomV(sampleCount);
+    std::vector<float> coherentU(sampleCount), coherentV(sampleCount);
+    for (size_t i = 0; i < sampleCount; i++) {
+        randomU[i] = unit(rng);
+        randomV[i] = unit(rng);
+    }
+    // Short vertical strokes of 64 samples, one texel apart, starting anywhere
+    for (size_t i = 0; i < sampleCount; i += 64) {
+        float u = unit(rng), v = unit(rng);
+        for (size_t k = 0; k < 64 && i + k < sampleCount; k++) {
+            coherentU[i + k] = u;
+            coherentV[i + k] = v + k / 8192.0f;
+        }
+    }
+
+    auto run = [&](const Texture& texture, const std::vector<float>& u, const std::vector<float>& v, float& checksum) {
+        double best = 1e30;
+        for (int r = 0; r < 3; r++) {
+            float sum = 0.0f;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < sampleCount; i++) {
+                Vec3 color = sampleTexture(texture, u[i], v[i]);
+                sum += color.x + color.y + color.z;
+            }
+            best = std::min(best, secondsSince(start));
+            checksum = sum;
+        }
+        return sampleCount / best / 1e6;
+    };
+
+    float rowRandomSum, tiledRandomSum, rowCoherentSum, tiledCoherentSum;
+    double rowRandom = run(rowMajor, randomU, randomV, rowRandomSum);
+    double tiledRandom = run(*tiled, randomU, randomV, tiledRandomSum);
+    double rowCoherent = run(rowMajor, coherentU, coherentV, rowCoherentSum);
+    double tiledCoherent = run(*tiled, coherentU, coherentV, tiledCoherentSum);
+
+    std::cout << "texture-layout: " << sampleCount << " samples, 8192x8192 texture" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  random    row-major: " << rowRandom << " M samples/s, tiled: " << tiledRandom << " M samples/s" << std::endl;
+    std::cout << "  coherent  row-major: " << rowCoherent << " M samples/s, tiled: " << tiledCoherent << " M samples/s" << std::endl;
+    std::cout << "  colors " << (rowRandomSum == tiledRandomSum && rowCoherentSum == tiledCoherentSum ? "match" : "DIFFER") << std::endl;
+}
+
+// Per-sample cost of each filter: scalar lookups against sampleTextureBatch,
+// on coherent coordinates like one texture's share of a sorted color pass.
+static void benchTextureFilter() {
+    const size_t sampleCount = 1 << 22;
+    std::shared_ptr<Texture> texture = std::make_shared<Texture>(makeSyntheticTexture(4096, 4096));
+    buildMipLevels(*texture);
+
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> u(sampleCount), v(sampleCount);
+    for (size_t i = 0; i < sampleCount; i += 64) {
+        float u0 = unit(rng), v0 = unit(rng);
+        for (size_t k = 0; k < 64 && i + k < sampleCount; k++) {
+            u[i + k] = u0 + k / 4096.0f;
+            v[i + k] = v0;
+        }
+    }
+    std::vector<Vec3> scalar(sampleCount), batch(sampleCount);
+
+    std::cout << "texture-filter: " << sampleCount << " samples, 4096x4096 texture"
+              << (sampleKernelUsesAVX2() ? " (AVX2)" : " (scalar)") << std::endl;
+    const char* names[] = {"nearest", "bilinear", "trilinear"};
+    const TextureFilter filters[] = {TextureFilter::Nearest, TextureFilter::Bilinear, TextureFilter::Trilinear};
+    const float lod = 1.5f;
+    for (int f = 0; f < 3; f++) {
+        double scalarBest = 1e30, batchBest = 1e30;
+        for (int r = 0; r < 3; r++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < sampleCount; i++) {
+                scalar[i] = sampleTextureFiltered(*texture, u[i], v[i], filters[f], lod);
+            }
+            scalarBest = std::min(scalarBest, secondsSince(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            sampleTextureBatch(*texture, u.data(), v.data(), sampleCount, batch.data(), filters[f], lod);
+            batchBest = std::min(batchBest, secondsSince(start));
+        }
+        bool match = true;
+        for (size_t i = 0; i < sampleCount && match; i++) {
+            match = scalar[i].x == batch[i].x && scalar[i].y == batch[i].y && scalar[i].z == batch[i].z;
+        }
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "  " << std::setw(9) << std::left << names[f] << std::right
+                  << " scalar: " << sampleCount / scalarBest / 1e6 << " M samples/s, batch: "
+                  << sampleCount / batchBest / 1e6 << " M samples/s, " << (match ? "match" : "DIFFER") << std::endl;
+    }
+}
+
+static void benchColorTransfer() {
+    const size_t sampleCount = 1 << 22;
+    std::mt19937 rng(5);
+    std::vector<uint32_t> texels(sampleCount);
+    for (auto& texel : texels) {
+        texel = rng() & 0xFFFFFF;
+    }
+    const ColorTransfer transfer;
+    std::vector<Vec3> exact(sampleCount), table(sampleCount);
+
+    double exactBest = 1e30, tableBest = 1e30;
+    for (int r = 0; r < 3; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < sampleCount; i++) {
+            Vec3 color(static_cast<float>(texels[i] & 0xFF), static_cast<float>((texels[i] >> 8) & 0xFF),
+                       static_cast<float>(texels[i] >> 16));
+            if (color.x < 200 && color.y < 200 && color.z < 200) {
+                color = color * 1.15f;
+            }
+            exact[i] = transfer.linearize(color);
+        }
+        exactBest = std::min(exactBest, secondsSince(start));
+
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < sampleCount; i++) {
+            table[i] = transfer.texelColor(texels[i]);
+        }
+        tableBest = std::min(tableBest, secondsSince(start));
+    }
+    bool match = true;
+    for (size_t i = 0; i < sampleCount && match; i++) {
+        match = exact[i].x == table[i].x && exact[i].y == table[i].y && exact[i].z == table[i].z;
+    }
+    std::cout << "color-transfer: " << sampleCount << " texels" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  pow: " << sampleCount / exactBest / 1e6 << " M texels/s, table: "
+              << sampleCount / tableBest / 1e6 << " M texels/s, " << (match ? "match" : "DIFFER") << std::endl;
+}
+
+// Scalar face-loop normals against computeVertexNormals on one worker (the
+// face loop) and on every core (the batch kernels)
+static void benchVertexNormals() {
+    const int cells = 1000;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes(1);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int j = 0; j <= cells; j++) {
+        for (int i = 0; i <= cells; i++) {
+            attrib.vertices.push_back(i);
+            attrib.vertices.push_back(j);
+            attrib.vertices.push_back(unit(rng));
+        }
+    }
+    tinyobj::mesh_t& mesh = shapes[0].mesh;
+    auto corner = [&](int i, int j) {
+        tinyobj::index_t idx;
+        idx.vertex_index = j * (cells + 1) + i;
+        idx.normal_index = -1;
+        idx.texcoord_index = -1;
+        mesh.indices.push_back(idx);
+    };
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            corner(i, j); corner(i + 1, j); corner(i + 1, j + 1);
+            corner(i, j); corner(i + 1, j + 1); corner(i, j + 1);
+            mesh.num_face_vertices.push_back(3);
+            mesh.num_face_vertices.push_back(3);
+            mesh.material_ids.push_back(-1);
+            mesh.material_ids.push_back(-1);
+        }
+    }
+
+    const size_t vertexCount = attrib.vertices.size() / 3;
+    std::vector<Vec3> scalar, serial, parallel;
+    double scalarBest = 1e30, serialBest = 1e30, parallelBest = 1e30;
+    for (int r = 0; r < 3; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        scalar = std::vector<Vec3>(vertexCount, Vec3(0, 0, 0));
+        for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+            Vec3 p[3];
+            for (int c = 0; c < 3; c++) {
+                int vertex = mesh.indices[3 * f + c].vertex_index;
+                p[c] = Vec3(static_cast<float>(attrib.vertices[3 * vertex + 0]),
+                            static_cast<float>(attrib.vertices[3 * vertex + 1]),
+                            static_cast<float>(attrib.vertices[3 * vertex + 2]));
+            }
+            Vec3 a(p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z);
+            Vec3 b(p[2].x - p[0].x, p[2].y - p[0].y, p[2].z - p[0].z);
+            Vec3 n(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+            float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            if (length > 0) {
+                n = Vec3(n.x / length, n.y / length, n.z / length);
+            }
+            for (int c = 0; c < 3; c++) {
+                Vec3& sum = scalar[mesh.indices[3 * f + c].vertex_index];
+                sum = sum + n;
+            }
+        }
+        for (auto& n : scalar) {
+            float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            if (length > 0) {
+                n = Vec3(n.x / length, n.y / length, n.z / length);
+            }
+        }
+        scalarBest = std::min(scalarBest, secondsSince(start));
+
+        start = std::chrono::high_resolution_clock::now();
+        serial = computeVertexNormals(attrib, shapes, 1);
+        serialBest = std::min(serialBest, secondsSince(start));
+        start = std::chrono::high_resolution_clock::now();
+        parallel = computeVertexNormals(attrib, shapes);
+        parallelBest = std::min(parallelBest, secondsSince(start));
+    }
+    bool match = std::memcmp(scalar.data(), serial.data(), vertexCount * sizeof(Vec3)) == 0 &&
+                 std::memcmp(scalar.data(), parallel.data(), vertexCount * sizeof(Vec3)) == 0;
+    std::cout << "vertex-normals: " << vertexCount << " vertices, " << mesh.num_face_vertices.size() << " faces"
+              << (sampleKernelUsesAVX2() ? " (AVX2)" : " (scalar)") << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  scalar face loop: " << scalarBest << " s, 1 worker (face loop): " << serialBest
+              << " s, " << std::thread::hardware_concurrency() << " workers (kernels): " << parallelBest << " s, "
+              << (match ? "match" : "DIFFER") << std::endl;
+}
+
+// Hashed color histogram against the pairwise unique-color scan it replaced
+static void benchColorStats() {
+    const size_t colorCount = 1 << 16;
+    const size_t paletteSize = 4096;
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<Vec3> palette(paletteSize);
+    for (auto& color : palette) {
+        color = Vec3(unit(rng), unit(rng), unit(rng));
+    }
+    std::vector<Vec3> colors(colorCount);
+    for (auto& color : colors) {
+        color = palette[rng() % paletteSize];
+    }
+    const ColorTransfer transfer;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Vec3> uniqueColors;
+    for (const Vec3& color : colors) {
+        bool found = false;
+        for (const Vec3& unique : uniqueColors) {
+            if (color.x == unique.x && color.y == unique.y && color.z == unique.z) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            uniqueColors.push_back(color);
+        }
+    }
+    double scanSeconds = secondsSince(start);
+
+    double histogramBest = 1e30;
+    ColorStatistics statistics;
+    for (int r = 0; r < 3; r++) {
+        start = std::chrono::high_resolution_clock::now();
+        statistics = computeColorStatistics(colors, transfer);
+        histogramBest = std::min(histogramBest, secondsSince(start));
+    }
+    std::cout << "color-stats: " << colorCount << " colors from a palette of " << paletteSize << std::endl;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "  pairwise scan: " << scanSeconds << " s (" << uniqueColors.size() << " unique), histogram: "
+              << histogramBest << " s (" << statistics.uniqueColors << " unique)" << std::endl;
+
+    // Enough distinct colors for several partitions, so the partitioned
+    // tables run; one worker and eight should take about as long per color
+    const size_t largeCount = 1 << 21;
+    std::vector<Vec3> largeColors(largeCount);
+    for (auto& color : largeColors) {
+        color = Vec3(unit(rng), unit(rng), unit(rng));
+    }
+    const unsigned int workerCounts[] = {1, 8};
+    ColorStatistics largeStatistics[2];
+    double largeBest[2] = {1e30, 1e30};
+    for (int w = 0; w < 2; w++) {
+        for (int r = 0; r < 3; r++) {
+            start = std::chrono::high_resolution_clock::now();
+            largeStatistics[w] = computeColorStatistics(largeColors, transfer, workerCounts[w]);
+            largeBest[w] = std::min(largeBest[w], secondsSince(start));
+        }
+    }
+    bool match = largeStatistics[0].uniqueColors == largeStatistics[1].uniqueColors;
+    std::cout << "  " << largeCount << " colors (" << largeStatistics[0].uniqueColors << " unique), 1 worker: "
+              << largeBest[0] << " s, 8 workers: " << largeBest[1] << " s, " << (match ? "match" : "DIFFER")
+              << std::endl;
+}
+
+// Per-channel scalar encode of AoS colors against the block kernel on SoA
+// channels, with intensity; values span the dark floor and the boost above 1
+static void benchColorEncode() {
+    const size_t colorCount = 1 << 22;
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> unit(0.0f, 1.2f);
+    std::vector<Vec3> colors(colorCount);
+    std::vector<float> red(colorCount), green(colorCount), blue(colorCount);
+    for (size_t i = 0; i < colorCount; i++) {
+        colors[i] = Vec3(unit(rng), unit(rng), unit(rng));
+        red[i] = colors[i].x;
+        green[i] = colors[i].y;
+        blue[i] = colors[i].z;
+    }
+    const ColorTransfer transfer;
+    std::vector<uint16_t> scalar(4 * colorCount), block(4 * colorCount);
+
+    double scalarBest = 1e30, blockBest = 1e30;
+    for (int r = 0; r < 3; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < colorCount; i++) {
+            scalar[i] = transfer.encode(colors[i].x);
+            scalar[colorCount + i] = transfer.encode(colors[i].y);
+            scalar[2 * colorCount + i] = transfer.encode(colors[i].z);
+            scalar[3 * colorCount + i] = ColorTransfer::encodeIntensity(colors[i]);
+        }
+        scalarBest = std::min(scalarBest, secondsSince(start));
+
+        start = std::chrono::high_resolution_clock::now();
+        transfer.encodeBlock(red.data(), green.data(), blue.data(), colorCount, &block[0], &block[colorCount],
+                             &block[2 * colorCount], &block[3 * colorCount]);
+        blockBest = std::min(blockBest, secondsSince(start));
+    }
+    std::cout << "color-encode: " << colorCount << " colors" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  scalar: " << colorCount / scalarBest / 1e6 << " M colors/s, block ("
+              << (sampleKernelUsesAVX2() ? "AVX2" : "scalar") << "): " << colorCount / blockBest / 1e6
+              << " M colors/s, " << (scalar == block ? "match" : "DIFFER") << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string only = argc > 1 ? argv[1] : "";
+    if (only.empty() || only == "sampling") {
+        benchSampling();
+    }
+    if (only.empty() || only == "color-pass") {
+        benchColorPass();
+    }
+    if (only.empty() || only == "texture-layout") {
+        benchTextureLayout();
+    }
+    if (only.empty() || only == "texture-filter") {
+        benchTextureFilter();
+    }
+    if (only.empty() || only == "color-transfer") {
+        benchColorTransfer();
+    }
+    if (only.empty() || only == "vertex-normals") {
+        benchVertexNormals();
+    }
+    if (only.empty() || only == "color-stats") {
+        benchColorStats();
+    }
+    if (only.empty() || only == "color-encode") {
+        benchColorEncode();
+    }
+    return 0;
+}
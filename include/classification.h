@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+// Must match the real_t used by the loader implementation in obj2las.cpp
+#ifndef TINYOBJLOADER_USE_DOUBLE
+#define TINYOBJLOADER_USE_DOUBLE
+#endif
+#include "tiny_obj_loader.h"
+
+// Largest classification code Point Data Record Format 3 can hold (5 bits)
+const unsigned int kMaxClassificationCode = 31;
+
+// One line of a classification rules file: materials whose name matches
+// pattern get code
+struct ClassificationRule {
+    std::string pattern;
+    uint8_t code = 0;
+};
+
+// Reads a rules file with one "pattern code" pair per line. Patterns are
+// case-insensitive globs where * matches any run of characters and ? any one;
+// blank lines and lines starting with # are skipped. Throws
+// std::runtime_error if the file cannot be read or a line is malformed.
+std::vector<ClassificationRule> loadClassificationRules(const std::string& filename);
+
+// Whether name matches a rule pattern (case-insensitive glob)
+bool classificationPatternMatches(const std::string& pattern, const std::string& name);
+
+// Classification code of every material id: the code of the first rule its
+// name matches, 0 (never classified) if none does. Matching happens once
+// here, so the color pass only indexes the table.
+std::vector<uint8_t> compileClassificationTable(const std::vector<ClassificationRule>& rules,
+                                                const std::vector<tinyobj::material_t>& materials);
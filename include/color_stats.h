@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "color_transfer.h"
+
+// A 16-bit LAS color and how many points have it
+struct ColorCount {
+    uint16_t red, green, blue;
+    size_t count;
+};
+
+// Channel percentiles reported by computeColorStatistics
+const int kColorPercentiles[] = {1, 5, 25, 50, 75, 95, 99};
+const size_t kColorPercentileCount = sizeof(kColorPercentiles) / sizeof(kColorPercentiles[0]);
+
+// Distribution of the 16-bit colors a conversion writes
+struct ColorStatistics {
+    size_t colorCount = 0;
+    size_t uniqueColors = 0;
+    // Most frequent colors, most frequent first (ties in color order)
+    std::vector<ColorCount> topColors;
+    // Nearest-rank kColorPercentiles of the red, green and blue values
+    uint16_t percentiles[3][kColorPercentileCount] = {};
+};
+
+// Quantizes every color with transfer.encode, as the LAS writer stores it,
+// and counts distinct colors in a hashed histogram. threads workers (0 = one
+// per core) hash their share of the colors into partitions, then build one
+// open-addressing table per partition, so the work stays linear in the
+// number of colors; the result does not depend on the worker count.
+ColorStatistics computeColorStatistics(const std::vector<Vec3>& colors, const ColorTransfer& transfer,
+                                       unsigned int threads = 0, size_t topCount = 10);
+
+void printColorStatistics(const ColorStatistics& statistics, std::ostream& out);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "texture.h"
+
+// Parameters of the chain that turns sampled texels into LAS colors: the 15%
+// boost sampleTexture gives texels that are not close to white, gamma
+// expansion to linear, a floor for very dark colors and 16-bit scaling.
+struct ColorTransferSettings {
+    float gamma = 2.2f;
+    // Linear values below this are raised to it before scaling to 16 bits
+    float darkFloor = 0.01f;
+};
+
+// The color-transfer stage of a conversion. Nearest texels, whose channels
+// are 8-bit, are linearized with a table load per channel; filtered and
+// averaged colors, which fall between texel values, take the exact path.
+// Both give the same result for the same input.
+class ColorTransfer {
+public:
+    explicit ColorTransfer(const ColorTransferSettings& settings = ColorTransferSettings());
+
+    // Linear color of a texel packed by nearestTexel (R in the low byte),
+    // boosted like sampleTexture
+    Vec3 texelColor(uint32_t rgb) const {
+        unsigned r = rgb & 0xFF, g = (rgb >> 8) & 0xFF, b = (rgb >> 16) & 0xFF;
+        const float* table = linear[r < 200 && g < 200 && b < 200 ? 1 : 0];
+        return Vec3(table[r], table[g], table[b]);
+    }
+
+    // Linear color of a color sampled on the 0-255 scale (boost already applied)
+    Vec3 linearize(const Vec3& sampled) const;
+
+    // Linear channel in fixed point, 65535 being full scale, clamped to [0, 1]
+    static uint32_t toFixedPoint(float value) {
+        return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    }
+
+    // texelColor in fixed point, one table load per channel
+    void texelFixedPoint(uint32_t rgb, uint32_t& r, uint32_t& g, uint32_t& b) const {
+        unsigned tr = rgb & 0xFF, tg = (rgb >> 8) & 0xFF, tb = (rgb >> 16) & 0xFF;
+        const uint16_t* table = fixedPoint[tr < 200 && tg < 200 && tb < 200 ? 1 : 0];
+        r = table[tr];
+        g = table[tg];
+        b = table[tb];
+    }
+
+    // 16-bit LAS value of a linear channel: raised to the dark floor,
+    // saturated at 1 (the texel boost can exceed it) and rounded
+    uint16_t encode(float value) const {
+        return static_cast<uint16_t>(std::min(std::max(value, parameters.darkFloor), 1.0f) * 65535.0f + 0.5f);
+    }
+
+    // encode of n colors given as channel arrays, and their encodeIntensity
+    // when intensity is not null, in one pass. Uses AVX2 when the CPU
+    // supports it; the result is the same either way.
+    void encodeBlock(const float* red, const float* green, const float* blue, size_t n, uint16_t* red16,
+                     uint16_t* green16, uint16_t* blue16, uint16_t* intensity) const;
+
+    // 16-bit LAS intensity of a linear color: its Rec. 709 luminance,
+    // clamped to [0, 1] and rounded like toFixedPoint
+    static uint16_t encodeIntensity(const Vec3& color) {
+        return static_cast<uint16_t>(toFixedPoint(0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z));
+    }
+
+    const ColorTransferSettings& settings() const { return parameters; }
+
+private:
+    ColorTransferSettings parameters;
+    // Linear value of every 8-bit channel value, without and with the boost,
+    // as float and in fixed point
+    float linear[2][256];
+    uint16_t fixedPoint[2][256];
+};
+
+// Per-vertex sums of linear colors in fixed point (see toFixedPoint) and
+// the number of colors summed, as separate arrays. A vertex can take 65537
+// full-scale colors before its sums overflow.
+class VertexColorSums {
+public:
+    explicit VertexColorSums(size_t vertexCount)
+        : red(vertexCount, 0), green(vertexCount, 0), blue(vertexCount, 0), count(vertexCount, 0) {}
+
+    void add(size_t vertex, const Vec3& color) {
+        red[vertex] += ColorTransfer::toFixedPoint(color.x);
+        green[vertex] += ColorTransfer::toFixedPoint(color.y);
+        blue[vertex] += ColorTransfer::toFixedPoint(color.z);
+        count[vertex]++;
+    }
+
+    // Same as add(vertex, transfer.texelColor(rgb)), without the conversions
+    void addTexel(size_t vertex, uint32_t rgb, const ColorTransfer& transfer) {
+        uint32_t r, g, b;
+        transfer.texelFixedPoint(rgb, r, g, b);
+        red[vertex] += r;
+        green[vertex] += g;
+        blue[vertex] += b;
+        count[vertex]++;
+    }
+
+    // Overwrites the color of every vertex that received at least one with
+    // the mean, rounded to the 16-bit step so ColorTransfer::encode gives it
+    // back exactly. Uses AVX2 when the CPU supports it.
+    void resolve(std::vector<Vec3>& colors) const;
+
+private:
+    std::vector<uint32_t> red, green, blue, count;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "color_transfer.h"
+#include "texture.h"
+// Must match the real_t used by the loader implementation in obj2las.cpp
+#ifndef TINYOBJLOADER_USE_DOUBLE
+#define TINYOBJLOADER_USE_DOUBLE
+#endif
+#include "tiny_obj_loader.h"
+
+struct ColorPassOptions {
+    // Bucket texture lookups by texture and 64x64 texel tile before sampling,
+    // then scatter the results back in face order. Produces the same colors as
+    // the file-order pass with far fewer cache and TLB misses on large atlases.
+    bool sortedSampling = false;
+    // Texture filter. Trilinear picks one mip level per texture from how many
+    // vertices sample it, and needs textures loaded with setTextureMipmaps.
+    TextureFilter filter = TextureFilter::Nearest;
+    // Average each vertex's color over its share of the incident faces' UV
+    // area instead of reading one texel, using the mip chain (so it also needs
+    // setTextureMipmaps). Overrides filter for textured vertices.
+    bool footprintColors = false;
+    // Give each vertex the mean color of all its face corners instead of the
+    // last face's color. Sums are kept in fixed point, so every pass and
+    // worker count gives the same result.
+    bool averageColors = false;
+    // Gamma of the texel to linear color conversion
+    ColorTransferSettings transfer;
+    // Workers of computeVertexColorsFromTextures' normal pass and file-order
+    // color pass (0 = one per core). Each owns a range of vertices and replays
+    // their corners in face order, so any count gives the serial result.
+    unsigned int threads = 0;
+};
+
+// Returns the decoded diffuse texture of a material id, nullptr if it has none
+typedef std::function<TexturePtr(size_t materialId)> MaterialTextureLoader;
+
+// UV bounds each material's faces sample its diffuse texture at, keyed by
+// diffuse_texname, for region-of-interest decoding (setTextureUvBounds)
+std::map<std::string, TextureUvBounds> computeTextureUvBounds(const tinyobj::attrib_t& attrib,
+                                                              const std::vector<tinyobj::shape_t>& shapes,
+                                                              const std::vector<tinyobj::material_t>& materials);
+
+// Number of vertices each diffuse texture colors, keyed by diffuse_texname,
+// for picking JPEG decode scales (setTextureSampleCounts)
+std::map<std::string, size_t> computeTextureSampleCounts(const tinyobj::attrib_t& attrib,
+                                                         const std::vector<tinyobj::shape_t>& shapes,
+                                                         const std::vector<tinyobj::material_t>& materials);
+
+// Per-vertex geometry the color pass can hand on to later stages. Each is
+// a stage of its own, run only when some consumer asks for it.
+enum VertexGeometryStage : unsigned int {
+    // Normalized sum of the face normals around each vertex
+    kVertexNormals = 1 << 0,
+    // 0.0001 along the vertex normal per textured corner; needs kVertexNormals
+    kVertexOffsets = 1 << 1,
+    // Classification code of the material of the face that colors each
+    // vertex, looked up in VertexGeometry::materialClasses
+    kVertexClasses = 1 << 2
+};
+
+// Normal stage on its own: the normalized sum of each vertex's face normals
+// on threads workers (0 = one per core). One worker runs the scalar face
+// loop; several split the work with the AVX2 face normal kernels.
+// Gives the normals the color pass produces for kVertexNormals.
+std::vector<Vec3> computeVertexNormals(const tinyobj::attrib_t& attrib,
+                                       const std::vector<tinyobj::shape_t>& shapes,
+                                       unsigned int threads = 0);
+
+// The requested stages plus every stage they depend on
+unsigned int vertexGeometryStages(unsigned int requested);
+
+struct VertexGeometry {
+    // VertexGeometryStage flags the consumers need, set before the color pass
+    unsigned int requested = 0;
+    // One entry per vertex for each stage that ran (requested or depended
+    // on), empty otherwise
+    std::vector<Vec3> normals;
+    std::vector<Vec3> offsets;
+    // Input of kVertexClasses: one code per material id (see
+    // compileClassificationTable)
+    std::vector<uint8_t> materialClasses;
+    // Output of kVertexClasses; 0 for vertices no face colors
+    std::vector<uint8_t> classes;
+};
+
+// Colors every vertex from its faces' material: the diffuse texture keyed by
+// diffuse_texname when one was loaded, the flat diffuse color otherwise.
+// Fills the geometry stages geometry->requested asks for; without geometry,
+// or with nothing requested, no normals, offsets or classes are computed.
+std::vector<Vec3> computeVertexColorsFromTextures(const tinyobj::attrib_t& attrib,
+                                                  const std::vector<tinyobj::shape_t>& shapes,
+                                                  const std::vector<tinyobj::material_t>& materials,
+                                                  const std::map<std::string, TexturePtr>& textures,
+                                                  const ColorPassOptions& options = ColorPassOptions(),
+                                                  VertexGeometry* geometry = nullptr);
+
+// Produces the same colors as computeVertexColorsFromTextures but works through
+// the faces one material group at a time, with materials sharing a texture
+// adjacent. Each texture is requested from the loader once and released after
+// its group, so a budgeted texture cache decodes, uses and evicts it at most
+// once. Materials count as textured when they name a diffuse texture.
+std::vector<Vec3> computeVertexColorsByMaterial(const tinyobj::attrib_t& attrib,
+                                                const std::vector<tinyobj::shape_t>& shapes,
+                                                const std::vector<tinyobj::material_t>& materials,
+                                                const MaterialTextureLoader& loadMaterialTexture,
+                                                const ColorPassOptions& options = ColorPassOptions());
+
+// Points of the seam-split output: one per distinct (vertex, texcoord) pair
+// that faces use, so a vertex on a UV seam gets a point per side, plus one
+// for every vertex no face uses. Ordered by vertex, then texcoord index.
+struct CornerPoints {
+    // OBJ vertex each point sits on
+    std::vector<uint32_t> vertices;
+    // Linear color of each point, sampled at its own texcoord
+    std::vector<Vec3> colors;
+};
+
+// Colors every distinct corner from the material of the last face using it
+// (the flat diffuse color for untextured materials). The distinct pairs are
+// collected on options.threads workers into a lock-free open-addressing
+// table; the result does not depend on the worker count. averageColors and
+// sortedSampling do not apply.
+CornerPoints computeCornerPointColors(const tinyobj::attrib_t& attrib,
+                                      const std::vector<tinyobj::shape_t>& shapes,
+                                      const std::vector<tinyobj::material_t>& materials,
+                                      const std::map<std::string, TexturePtr>& textures,
+                                      const ColorPassOptions& options = ColorPassOptions());
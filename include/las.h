@@ -63,24 +63,97 @@ struct LASPoint {
 };
 #pragma pack(pop)
 
+// Storage of per-point normals, appended to every point record as three
+// Extra Bytes fields (NormalX, NormalY, NormalZ) described by a LASF_Spec
+// record 4 VLR. Int16 stores round(n * 32767) with a scale of 1 / 32767.
+// Extra Bytes are defined by LAS 1.4; the header still says 1.3, and
+// strict 1.3 readers see the fields only as undocumented record bytes.
+enum class LASNormalFormat {
+    None,
+    Float32,
+    Int16
+};
+
+#pragma pack(push, 1)
+struct LASVariableLengthRecordHeader {
+    uint16_t reserved;
+    char userID[16];
+    uint16_t recordID;
+    uint16_t recordLengthAfterHeader;
+    char description[32];
+};
+
+// One Extra Bytes field description (LAS 1.4 R15, section 2.6)
+struct LASExtraBytesDescriptor {
+    uint8_t reserved[2];
+    uint8_t dataType;
+    uint8_t options;
+    char name[32];
+    uint8_t unused[4];
+    uint8_t noData[24];
+    uint8_t min[24];
+    uint8_t max[24];
+    double scale[3];
+    double offset[3];
+    char description[32];
+};
+#pragma pack(pop)
+
+// A run of points for LAS13Writer::addPoints, one array per field, each of
+// length count. intensity, classification and the normal arrays may be
+// null: intensity and classification are then written as 0, and normals as 0
+// when the file stores them.
+struct LASPointBatch {
+    size_t count = 0;
+    const double* x = nullptr;
+    const double* y = nullptr;
+    const double* z = nullptr;
+    const uint16_t* red = nullptr;
+    const uint16_t* green = nullptr;
+    const uint16_t* blue = nullptr;
+    const uint16_t* intensity = nullptr;
+    // Classification codes, 0 to 31
+    const uint8_t* classification = nullptr;
+    const float* normalX = nullptr;
+    const float* normalY = nullptr;
+    const float* normalZ = nullptr;
+};
+
 class LAS13Writer {
 public:
-    bool open(const std::string& fname);
+    // Points carry normals in the given format after the Format 3 fields
+    bool open(const std::string& fname, LASNormalFormat normals = LASNormalFormat::None);
     void addPointColor(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b);
+    // Packs the normal into the point's extra bytes; ignored when the file
+    // was opened without normals
+    void addPointColorNormal(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b,
+                             float nx, float ny, float nz);
+    // Encodes a whole batch straight into the point buffer, with a loop
+    // specialized for the file's record format
+    void addPoints(const LASPointBatch& batch);
     void close();
+    // Header fields and point data size, for --verbose runs
+    void printHeader(std::ostream& out) const;
 
 private:
     std::ofstream file;
     std::string filename;
     LASHeader header;
     bool isFirstPoint;
+    LASNormalFormat normalFormat;
 
 
-
+    // Points are staged here and flushed to disk once flushThreshold bytes accumulate
+    static const size_t flushThreshold = 34 * 65536;
     std::vector<char> pointBuffer;
+    uint64_t bytesWritten;
 
     void initializeHeader();
     void updateHeaderBounds(double x, double y, double z);
     void writeHeader();
+    void writeExtraBytesRecord();
+    void appendPoint(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b, const float* normal);
+    template <LASNormalFormat Normals>
+    void encodePoints(const LASPointBatch& batch, char* records);
     void writePoints();
 };
\ No newline at end of file
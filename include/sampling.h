@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "texture.h"
+// Must match the real_t used by the loader implementation in obj2las.cpp
+#ifndef TINYOBJLOADER_USE_DOUBLE
+#define TINYOBJLOADER_USE_DOUBLE
+#endif
+#include "tiny_obj_loader.h"
+
+// Triangle soup layout for surface sampling. Corner attributes are stored
+// contiguously per triangle (corner c of triangle t lives at index 3 * t + c),
+// so kernels can gather them without chasing tinyobj::index_t triplets.
+// Positions are relative to origin to keep float precision on georeferenced
+// models.
+struct TriangleMesh {
+    double origin[3];
+    std::vector<float> x, y, z;
+    std::vector<float> u, v;
+    std::vector<int32_t> materialIds;
+
+    size_t triangleCount() const { return materialIds.size(); }
+};
+
+// Structure-of-arrays outputs of interpolateSamples, each of length n.
+// Colors use the same 0-255 scale as sampleTexture.
+struct SampleOutputs {
+    float* x;
+    float* y;
+    float* z;
+    float* u;
+    float* v;
+    float* r;
+    float* g;
+    float* b;
+};
+
+// Builds the triangle layout from an OBJ, fan-triangulating polygons.
+// Missing texture coordinates become (0, 0).
+TriangleMesh buildTriangleMesh(const tinyobj::attrib_t& attrib,
+                               const std::vector<tinyobj::shape_t>& shapes);
+
+// Interpolates positions and UVs at barycentric (u, v) of the given triangles
+// and fetches the nearest texel from textures[materialId]. The V coordinate is
+// flipped and wrapped like the color pass does. Lanes without a texture get a
+// black color. Uses AVX2 when the CPU supports it, scalar code otherwise.
+void interpolateSamples(const TriangleMesh& mesh,
+                        const std::vector<const Texture*>& textures,
+                        const int32_t* triangles, const float* baryU, const float* baryV,
+                        size_t n, const SampleOutputs& out);
+
+// Same as interpolateSamples but always takes the scalar path.
+void interpolateSamplesScalar(const TriangleMesh& mesh,
+                              const std::vector<const Texture*>& textures,
+                              const int32_t* triangles, const float* baryU, const float* baryV,
+                              size_t n, const SampleOutputs& out);
+
+bool sampleKernelUsesAVX2();
+
+// Samples n texture coordinates (already flipped like sampleTexture expects)
+// with the given filter, writing colors on the 0-255 scale. Results equal
+// sampleTexture for Nearest and sampleTextureFiltered otherwise; lod is the
+// trilinear mip level shared by the whole batch. Uses AVX2 gathers when the
+// CPU supports them.
+void sampleTextureBatch(const Texture& texture, const float* u, const float* v, size_t n, Vec3* out,
+                        TextureFilter filter = TextureFilter::Nearest, float lod = 0.0f);
+
+// Texels nearestTexel returns for n texture coordinates, gathered with AVX2
+// when the CPU supports it. Feeds ColorTransfer::texelColor.
+void sampleTexelBatch(const Texture& texture, const float* u, const float* v, size_t n, uint32_t* out);
+
+// First three corner positions of a run of faces, one array per corner and
+// coordinate (x[1][i] is the x of face i's second corner)
+struct FaceCornerBatch {
+    const float* x[3];
+    const float* y[3];
+    const float* z[3];
+};
+
+// Unit normals of the planes through each face's three corners, the cross
+// product of the edges from corner 0, 0 for degenerate faces. Bit-identical
+// to the scalar color-pass normals; uses AVX2 when the CPU supports it.
+void faceNormalBatch(const FaceCornerBatch& corners, size_t n, Vec3* out);
+
+// Normalizes n vectors in place, leaving zero vectors at zero. Same float
+// operations as the scalar path, 8 vectors at a time with AVX2 when the CPU
+// supports it.
+void normalizeBatch(Vec3* v, size_t n);
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <cstdint>
 // #include "../src/texture.cpp"
 
 struct Vec3 {
@@ -12,16 +15,218 @@ struct Vec3 {
     Vec3 operator*(float scalar) const { return Vec3(x * scalar, y * scalar, z * scalar); }
 };
 
+// Pixel bytes of a texture. Either owned, or borrowed from external storage
+// (the stb_image decode buffer, a memory-mapped disk cache file) that is
+// released together with the last copy of the buffer.
+class PixelBuffer {
+public:
+    PixelBuffer() : length(0) {}
+
+    void assign(const unsigned char* first, const unsigned char* last) {
+        external.reset();
+        owned.assign(first, last);
+        length = owned.size();
+    }
+    void resize(size_t size) {
+        external.reset();
+        owned.resize(size);
+        length = size;
+    }
+    void adopt(std::shared_ptr<const unsigned char> storage, size_t size) {
+        owned.clear();
+        external = storage;
+        length = size;
+    }
+
+    const unsigned char* data() const { return external ? external.get() : owned.data(); }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const unsigned char& operator[](size_t i) const { return data()[i]; }
+    // Write access is only valid for owned buffers
+    unsigned char& operator[](size_t i) { return owned[i]; }
+
+private:
+    std::vector<unsigned char> owned;
+    std::shared_ptr<const unsigned char> external;
+    size_t length;
+};
+
+// Storage order of texels in Texture::data. Row-major is what decoders emit;
+// tiled stores 32x32 texel blocks contiguously (rows padded to whole tiles) so
+// lookups that wander vertically stay within a few cache lines and pages.
+enum class TextureLayout : uint32_t {
+    RowMajor = 0,
+    Tiled = 1
+};
+
+enum class TextureFilter {
+    Nearest,
+    Bilinear,
+    // Bilinear on the two mip levels around the requested level of detail
+    Trilinear
+};
+
+const int kTextureTileShift = 5;
+const int kTextureTileSize = 1 << kTextureTileShift;
+
 struct Texture {
-    int width, height, channels;
-    std::vector<unsigned char> data;
+    int width = 0, height = 0, channels = 0;
+    TextureLayout layout = TextureLayout::RowMajor;
+    // Textures decoded from a region of interest hold only texels
+    // [originX, originX + width) x [originY, originY + height) of an
+    // imageWidth x imageHeight image, and UVs keep mapping onto the whole
+    // image. imageWidth and imageHeight are 0 for whole-image textures.
+    int originX = 0, originY = 0;
+    int imageWidth = 0, imageHeight = 0;
+    // Always 3 bytes per texel, whatever the source channel count
+    PixelBuffer data;
+    // Successively halved row-major copies (level 1, 2, ... down to 1x1),
+    // present when mipmaps were enabled at load time
+    std::vector<std::shared_ptr<const Texture> > mipLevels;
+
+    // Mip level k, where level 0 is the texture itself
+    const Texture& level(int k) const { return k == 0 ? *this : *mipLevels[k - 1]; }
+    int levelCount() const { return static_cast<int>(mipLevels.size()) + 1; }
+
+    // Size of the texel grid UVs map onto
+    int uvWidth() const { return imageWidth > 0 ? imageWidth : width; }
+    int uvHeight() const { return imageHeight > 0 ? imageHeight : height; }
+    // Stored column / row of image column / row x / y, clamped to what is stored
+    int storedX(int x) const { return std::max(0, std::min(x - originX, width - 1)); }
+    int storedY(int y) const { return std::max(0, std::min(y - originY, height - 1)); }
+
+    int tilesX() const { return (width + kTextureTileSize - 1) >> kTextureTileShift; }
+    int tilesY() const { return (height + kTextureTileSize - 1) >> kTextureTileShift; }
+
+    // Byte offset of texel (x, y) in data
+    size_t texelOffset(int x, int y) const {
+        if (layout == TextureLayout::RowMajor) {
+            return (static_cast<size_t>(y) * width + x) * 3;
+        }
+        const int mask = kTextureTileSize - 1;
+        size_t tile = static_cast<size_t>(y >> kTextureTileShift) * tilesX() + (x >> kTextureTileShift);
+        return ((tile << (2 * kTextureTileShift)) + ((y & mask) << kTextureTileShift) + (x & mask)) * 3;
+    }
+};
+
+// Decoded textures are immutable once loaded and shared by every consumer,
+// so each image is held in memory exactly once.
+typedef std::shared_ptr<const Texture> TexturePtr;
+
+struct TextureCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    // Misses served from the decoded-texture disk cache instead of decoding
+    size_t diskHits = 0;
 };
 
 std::string getParentPath(const std::string& path);
 std::string joinPaths(const std::string& path1, const std::string& path2);
 bool fileExists(const std::string& filename);
-Texture loadTexture(const std::string& filename);
+// Returns the cached texture or decodes it; nullptr if it cannot be loaded.
+TexturePtr loadTexture(const std::string& filename);
 Vec3 sampleTexture(const Texture& texture, float u, float v);
 
+// The texel sampleTexture reads, before its brightness boost, packed as
+// R | G << 8 | B << 16. 0 where sampleTexture returns black for an
+// unsupported channel count.
+uint32_t nearestTexel(const Texture& texture, float u, float v);
+
+// Filtered lookup on the same 0-255 scale and with the same brightness boost
+// as sampleTexture. lod selects the mip level for trilinear filtering
+// (0 = full resolution, fractional values blend two levels).
+Vec3 sampleTextureFiltered(const Texture& texture, float u, float v, TextureFilter filter, float lod);
+
+// Fills texture.mipLevels with 2x2 box-filtered levels down to 1x1
+void buildMipLevels(Texture& texture);
+
+// Builds mip levels for every texture loaded from now on (needed for
+// trilinear filtering). Each texture's chain is built by the thread that
+// decodes it, so loadTexturesParallel builds them in parallel.
+void setTextureMipmaps(bool enabled);
+
+// Bytes of pixel storage a texture of this size needs in the given layout
+size_t textureStorageSize(int width, int height, TextureLayout layout);
+
+// Copy of a texture reordered into the given layout
+std::shared_ptr<Texture> convertTextureLayout(const Texture& source, TextureLayout layout);
+
+// Textures with at least this many texels are converted to the tiled layout
+// when loaded. 0 keeps every texture row-major.
+void setTextureTilingThreshold(size_t texels);
+
+// Caps the bytes of decoded pixels the texture cache keeps, evicting the least
+// recently used textures beyond it. 0 (the default) keeps everything. Evicted
+// textures stay alive while a consumer still holds them.
+void setTextureCacheBudget(size_t bytes);
+TextureCacheStats textureCacheStats();
+
+// Keeps raw decoded pixels of every texture in directory and maps them on
+// later runs instead of decoding, as long as the source file's size and
+// modification time are unchanged. An empty directory disables the cache.
+void setTextureDiskCache(const std::string& directory);
+
+// Part of a texture's UV square that faces reference, in the coordinates
+// sampleTexture takes (V already flipped), wrapped into [0, 1) like it does
+struct TextureUvBounds {
+    float minU = 1.0f, minV = 1.0f;
+    float maxU = 0.0f, maxV = 0.0f;
+
+    bool empty() const { return minU > maxU; }
+};
+
+// Grows bounds by the wrapped coordinates sampleTexture would read at (u, v)
+void extendTextureUvBounds(TextureUvBounds& bounds, float u, float v);
+
+// Decode only the texels these bounds can reach (plus the neighbours bilinear
+// filtering reads) for textures loaded from now on, keyed by filename. JPEGs
+// are decoded strip by strip when built with libjpeg-turbo; other formats are
+// cropped right after decoding. Ignored while mip levels are enabled, which
+// need the whole image.
+void setTextureUvBounds(const std::map<std::string, TextureUvBounds>& bounds);
+
+// Number of points sampled from each texture loaded from now on, keyed by
+// filename. With libjpeg-turbo, JPEGs sampled far more sparsely than they
+// have texels are decoded at 1/2, 1/4 or 1/8 scale in the DCT domain.
+void setTextureSampleCounts(const std::map<std::string, size_t>& samples);
+
+// JPEG decode scale denominator: 0 (the default) picks it from the sample
+// counts, 1, 2, 4 or 8 forces it for every JPEG
+void setTextureDecodeScale(int denominator);
+
+// Whether this build decodes JPEGs scaled (libjpeg-turbo). Without it the
+// decode scale and sample counts are ignored.
+bool jpegScaledDecodeAvailable();
+
+// Size in bytes the texture occupies once decoded, read from the image header
+// without decoding. 0 if the file is missing or not a supported image.
+size_t decodedTextureSize(const std::string& filename);
+
+// Decodes every distinct file on a pool of threadCount workers (0 = one per
+// core) into the shared texture cache. Keyed by filename; files that fail to
+// load are reported and left out without holding up the others.
+std::map<std::string, TexturePtr> loadTexturesParallel(const std::vector<std::string>& filenames,
+                                                       unsigned int threadCount);
+
+// Every texture of a model decoded into one anonymous mapping (huge-page
+// backed where the kernel allows), instead of one heap block per image.
+struct TextureArena {
+    std::shared_ptr<const unsigned char> storage;
+    size_t size = 0;
+    // Texture views of the same pixels, usable wherever a TexturePtr is
+    // expected; they keep the arena alive
+    std::map<std::string, TexturePtr> textures;
+};
+
+// Like loadTexturesParallel, but sizes the arena from the image headers,
+// then decodes each file straight into its slot on threadCount workers. The
+// texture cache is bypassed. Mip levels, when enabled, are kept outside the
+// arena. nullptr if the arena cannot be allocated.
+std::shared_ptr<const TextureArena> loadTextureArena(const std::vector<std::string>& filenames,
+                                                     unsigned int threadCount);
+
 // New function to load multiple textures
-std::map<std::string, Texture> loadTextures(const std::string& mtlFilename);
\ No newline at end of file
+std::map<std::string, TexturePtr> loadTextures(const std::string& mtlFilename);
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "include/classification.h"
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static inline char foldCase(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+bool classificationPatternMatches(const std::string& pattern, const std::string& name) {
+    // Greedy match that backtracks to the last * on a mismatch; linear in
+    // practice for the short names materials have
+    size_t p = 0, n = 0;
+    size_t starP = std::string::npos, starN = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || foldCase(pattern[p]) == foldCase(name[n]))) {
+            p++;
+            n++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+        } else if (starP != std::string::npos) {
+            p = starP + 1;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+std::vector<ClassificationRule> loadClassificationRules(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open classification rules: " + filename);
+    }
+    std::vector<ClassificationRule> rules;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        std::istringstream fields(line);
+        std::string pattern;
+        if (!(fields >> pattern) || pattern[0] == '#') {
+            continue;
+        }
+        unsigned int code = 0;
+        std::string rest;
+        if (!(fields >> code) || (fields >> rest) || code > kMaxClassificationCode) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) +
+                                     ": expected \"pattern code\" with a code from 0 to " +
+                                     std::to_string(kMaxClassificationCode));
+        }
+        ClassificationRule rule;
+        rule.pattern = pattern;
+        rule.code = static_cast<uint8_t>(code);
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+std::vector<uint8_t> compileClassificationTable(const std::vector<ClassificationRule>& rules,
+                                                const std::vector<tinyobj::material_t>& materials) {
+    std::vector<uint8_t> table(materials.size(), 0);
+    for (size_t m = 0; m < materials.size(); m++) {
+        for (const auto& rule : rules) {
+            if (classificationPatternMatches(rule.pattern, materials[m].name)) {
+                table[m] = rule.code;
+                break;
+            }
+        }
+    }
+    return table;
+}
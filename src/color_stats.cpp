@@ -0,0 +1,198 @@
+#include "include/color_stats.h"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Colors per worker below which more workers only add overhead
+const size_t kColorsPerWorker = 1 << 16;
+
+// Runs task(worker) on workerCount threads, the calling thread being worker 0
+void runWorkers(unsigned int workerCount, const std::function<void(unsigned int)>& task) {
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < workerCount; t++) {
+        workers.push_back(std::thread(task, t));
+    }
+    task(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// R | G << 16 | B << 32 of a color as the LAS writer stores it
+uint64_t colorKey(const Vec3& color, const ColorTransfer& transfer) {
+    return static_cast<uint64_t>(transfer.encode(color.x)) | static_cast<uint64_t>(transfer.encode(color.y)) << 16 |
+           static_cast<uint64_t>(transfer.encode(color.z)) << 32;
+}
+
+uint64_t hashKey(uint64_t key) {
+    return key * 0x9E3779B97F4A7C15ULL;
+}
+
+// Partition of a key among partitionCount, from the high hash bits
+size_t keyPartition(uint64_t key, size_t partitionCount) {
+    return static_cast<size_t>(((hashKey(key) >> 32) * partitionCount) >> 32);
+}
+
+// Hash for table slots within a partition (murmur3 finalizer). It must not
+// reuse the bits keyPartition takes, or every key of a partition would fall
+// into the same slice of its table.
+uint64_t slotHash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Distinct keys of one partition with their counts, via linear probing
+void countKeys(const uint64_t* keys, size_t n, std::vector<ColorCount>& counts) {
+    const uint64_t kEmpty = UINT64_MAX;
+    int bits = 4;
+    while ((size_t(1) << bits) < 2 * n) {
+        bits++;
+    }
+    const size_t mask = (size_t(1) << bits) - 1;
+    std::vector<uint64_t> slots(mask + 1, kEmpty);
+    std::vector<size_t> slotCounts(mask + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = static_cast<size_t>(slotHash(keys[i])) & mask;
+        while (slots[slot] != keys[i] && slots[slot] != kEmpty) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = keys[i];
+        slotCounts[slot]++;
+    }
+    for (size_t slot = 0; slot <= mask; slot++) {
+        if (slots[slot] != kEmpty) {
+            ColorCount entry = {static_cast<uint16_t>(slots[slot]), static_cast<uint16_t>(slots[slot] >> 16),
+                                static_cast<uint16_t>(slots[slot] >> 32), slotCounts[slot]};
+            counts.push_back(entry);
+        }
+    }
+}
+
+bool moreFrequent(const ColorCount& a, const ColorCount& b) {
+    if (a.count != b.count) {
+        return a.count > b.count;
+    }
+    if (a.red != b.red) {
+        return a.red < b.red;
+    }
+    if (a.green != b.green) {
+        return a.green < b.green;
+    }
+    return a.blue < b.blue;
+}
+
+}  // namespace
+
+ColorStatistics computeColorStatistics(const std::vector<Vec3>& colors, const ColorTransfer& transfer,
+                                       unsigned int threads, size_t topCount) {
+    ColorStatistics statistics;
+    const size_t n = colors.size();
+    statistics.colorCount = n;
+    if (n == 0) {
+        return statistics;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const unsigned int workerCount =
+        static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, n / kColorsPerWorker)));
+    const size_t partitionCount = workerCount;
+    auto rangeBegin = [&](unsigned int worker) { return n * worker / workerCount; };
+
+    // Quantize each worker's colors, counting keys per partition and values
+    // per channel
+    std::vector<uint64_t> keys(n);
+    std::vector<std::vector<size_t> > partitionSizes(workerCount, std::vector<size_t>(partitionCount, 0));
+    std::vector<std::vector<uint32_t> > channelHistograms(workerCount);
+    runWorkers(workerCount, [&](unsigned int worker) {
+        std::vector<uint32_t>& histogram = channelHistograms[worker];
+        histogram.assign(3 * 65536, 0);
+        for (size_t i = rangeBegin(worker); i < rangeBegin(worker + 1); i++) {
+            keys[i] = colorKey(colors[i], transfer);
+            partitionSizes[worker][keyPartition(keys[i], partitionCount)]++;
+            histogram[keys[i] & 0xFFFF]++;
+            histogram[65536 + ((keys[i] >> 16) & 0xFFFF)]++;
+            histogram[2 * 65536 + (keys[i] >> 32)]++;
+        }
+    });
+
+    // Scatter keys into contiguous partitions, each worker into its own slots
+    std::vector<size_t> partitionStart(partitionCount + 1, 0);
+    std::vector<std::vector<size_t> > cursor(workerCount, std::vector<size_t>(partitionCount, 0));
+    size_t offset = 0;
+    for (size_t p = 0; p < partitionCount; p++) {
+        partitionStart[p] = offset;
+        for (unsigned int worker = 0; worker < workerCount; worker++) {
+            cursor[worker][p] = offset;
+            offset += partitionSizes[worker][p];
+        }
+    }
+    partitionStart[partitionCount] = offset;
+    std::vector<uint64_t> partitioned(n);
+    runWorkers(workerCount, [&](unsigned int worker) {
+        for (size_t i = rangeBegin(worker); i < rangeBegin(worker + 1); i++) {
+            partitioned[cursor[worker][keyPartition(keys[i], partitionCount)]++] = keys[i];
+        }
+    });
+
+    // One table per partition; a color only ever lands in one
+    std::vector<std::vector<ColorCount> > partitionCounts(partitionCount);
+    runWorkers(workerCount, [&](unsigned int worker) {
+        countKeys(&partitioned[0] + partitionStart[worker], partitionStart[worker + 1] - partitionStart[worker],
+                  partitionCounts[worker]);
+    });
+    std::vector<ColorCount> counts;
+    for (const auto& partition : partitionCounts) {
+        statistics.uniqueColors += partition.size();
+        counts.insert(counts.end(), partition.begin(), partition.end());
+    }
+    size_t top = std::min(topCount, counts.size());
+    std::partial_sort(counts.begin(), counts.begin() + top, counts.end(), moreFrequent);
+    statistics.topColors.assign(counts.begin(), counts.begin() + top);
+
+    for (int channel = 0; channel < 3; channel++) {
+        size_t seen = 0;
+        size_t percentile = 0;
+        for (size_t value = 0; value < 65536 && percentile < kColorPercentileCount; value++) {
+            for (const auto& histogram : channelHistograms) {
+                seen += histogram[channel * 65536 + value];
+            }
+            // Nearest rank: the smallest value at least ceil(p% of n) colors reach
+            while (percentile < kColorPercentileCount &&
+                   seen * 100 >= static_cast<size_t>(kColorPercentiles[percentile]) * n) {
+                statistics.percentiles[channel][percentile++] = static_cast<uint16_t>(value);
+            }
+        }
+    }
+    return statistics;
+}
+
+void printColorStatistics(const ColorStatistics& statistics, std::ostream& out) {
+    out << "Color statistics: " << statistics.colorCount << " colors, " << statistics.uniqueColors << " unique"
+        << std::endl;
+    out << "  Top colors (R, G, B: count):" << std::endl;
+    for (const auto& color : statistics.topColors) {
+        out << "    " << color.red << ", " << color.green << ", " << color.blue << ": " << color.count << std::endl;
+    }
+    const char* names[3] = {"red", "green", "blue"};
+    out << "  Percentiles";
+    for (size_t p = 0; p < kColorPercentileCount; p++) {
+        out << std::setw(7) << ("p" + std::to_string(kColorPercentiles[p]));
+    }
+    out << std::endl;
+    for (int channel = 0; channel < 3; channel++) {
+        out << "  " << std::left << std::setw(11) << names[channel] << std::right;
+        for (size_t p = 0; p < kColorPercentileCount; p++) {
+            out << std::setw(7) << statistics.percentiles[channel][p];
+        }
+        out << std::endl;
+    }
+}
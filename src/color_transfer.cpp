@@ -0,0 +1,155 @@
+#include "include/color_transfer.h"
+#include "include/sampling.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBJ2LAS_HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+ColorTransfer::ColorTransfer(const ColorTransferSettings& settings) : parameters(settings) {
+    // Same operations as linearize on the boosted or unboosted value, so both
+    // paths agree to the bit
+    for (int value = 0; value < 256; value++) {
+        float plain = static_cast<float>(value);
+        float boosted = plain * 1.15f;
+        linear[0][value] = std::pow(plain / 255.0f, parameters.gamma);
+        linear[1][value] = std::pow(boosted / 255.0f, parameters.gamma);
+        fixedPoint[0][value] = static_cast<uint16_t>(toFixedPoint(linear[0][value]));
+        fixedPoint[1][value] = static_cast<uint16_t>(toFixedPoint(linear[1][value]));
+    }
+}
+
+Vec3 ColorTransfer::linearize(const Vec3& sampled) const {
+    return Vec3(std::pow(sampled.x / 255.0f, parameters.gamma),
+                std::pow(sampled.y / 255.0f, parameters.gamma),
+                std::pow(sampled.z / 255.0f, parameters.gamma));
+}
+
+// Mean of sum / count in 16-bit steps, as a linear value
+static inline float meanChannel(uint32_t sum, uint32_t count) {
+    float steps = std::nearbyint(static_cast<float>(sum) / static_cast<float>(count));
+    return steps / 65535.0f;
+}
+
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+
+// uint32 lanes to float, rounded once like static_cast<float>: both 16-bit
+// halves convert exactly, and so does the high half scaled by 2^16, so only
+// the sum rounds. cvtepi32_ps alone reads lanes of 2^31 and up as negative.
+__attribute__((target("avx2")))
+static inline __m256 convertUnsigned8(__m256i values) {
+    __m256 high = _mm256_cvtepi32_ps(_mm256_srli_epi32(values, 16));
+    __m256 low = _mm256_cvtepi32_ps(_mm256_and_si256(values, _mm256_set1_epi32(0xFFFF)));
+    return _mm256_add_ps(_mm256_mul_ps(high, _mm256_set1_ps(65536.0f)), low);
+}
+
+// 8 vertices per step with the same float operations as meanChannel
+// (conversions round to nearest even, like nearbyint in the default mode)
+__attribute__((target("avx2")))
+static void resolveColorSumsAVX2(const uint32_t* red, const uint32_t* green, const uint32_t* blue,
+                                 const uint32_t* count, size_t n, Vec3* colors) {
+    const __m256 fullScale = _mm256_set1_ps(65535.0f);
+    alignas(32) float r[8], g[8], b[8];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i counts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(count + i));
+        if (_mm256_testz_si256(counts, counts)) {
+            continue;
+        }
+        // Lanes without colors divide by zero and are skipped below
+        __m256 divisor = convertUnsigned8(counts);
+        const uint32_t* sums[3] = {red, green, blue};
+        float* means[3] = {r, g, b};
+        for (int c = 0; c < 3; c++) {
+            __m256 sum = convertUnsigned8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums[c] + i)));
+            __m256 steps = _mm256_cvtepi32_ps(_mm256_cvtps_epi32(_mm256_div_ps(sum, divisor)));
+            _mm256_store_ps(means[c], _mm256_div_ps(steps, fullScale));
+        }
+        for (int lane = 0; lane < 8; lane++) {
+            if (count[i + lane] > 0) {
+                colors[i + lane] = Vec3(r[lane], g[lane], b[lane]);
+            }
+        }
+    }
+    for (; i < n; i++) {
+        if (count[i] > 0) {
+            colors[i] = Vec3(meanChannel(red[i], count[i]), meanChannel(green[i], count[i]),
+                             meanChannel(blue[i], count[i]));
+        }
+    }
+}
+
+// 8 channel values to 16 bits with encode's operations: floor, saturate,
+// scale and round by truncating value + 0.5
+__attribute__((target("avx2")))
+static inline void encodeChannel8(const float* values, __m256 low, __m256 high, uint16_t* out) {
+    const __m256 fullScale = _mm256_set1_ps(65535.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(values), low), high);
+    __m256i steps = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, fullScale), half));
+    // Steps fit 16 bits, so the saturating pack only drops the high halves
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(steps, steps), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+}
+
+__attribute__((target("avx2")))
+static size_t encodeBlockAVX2(const float* red, const float* green, const float* blue, size_t n, float darkFloor,
+                              uint16_t* red16, uint16_t* green16, uint16_t* blue16, uint16_t* intensity) {
+    const __m256 darkFloor8 = _mm256_set1_ps(darkFloor);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        encodeChannel8(red + i, darkFloor8, one, red16 + i);
+        encodeChannel8(green + i, darkFloor8, one, green16 + i);
+        encodeChannel8(blue + i, darkFloor8, one, blue16 + i);
+        if (intensity) {
+            // Same product and sum order as encodeIntensity, without FMA
+            __m256 luminance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.2126f), _mm256_loadu_ps(red + i)),
+                              _mm256_mul_ps(_mm256_set1_ps(0.7152f), _mm256_loadu_ps(green + i))),
+                _mm256_mul_ps(_mm256_set1_ps(0.0722f), _mm256_loadu_ps(blue + i)));
+            alignas(32) float values[8];
+            _mm256_store_ps(values, luminance);
+            encodeChannel8(values, zero, one, intensity + i);
+        }
+    }
+    return i;
+}
+
+#endif
+
+void ColorTransfer::encodeBlock(const float* red, const float* green, const float* blue, size_t n,
+                                uint16_t* red16, uint16_t* green16, uint16_t* blue16, uint16_t* intensity) const {
+    size_t i = 0;
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    if (sampleKernelUsesAVX2()) {
+        i = encodeBlockAVX2(red, green, blue, n, parameters.darkFloor, red16, green16, blue16, intensity);
+    }
+#endif
+    for (; i < n; i++) {
+        red16[i] = encode(red[i]);
+        green16[i] = encode(green[i]);
+        blue16[i] = encode(blue[i]);
+        if (intensity) {
+            intensity[i] = encodeIntensity(Vec3(red[i], green[i], blue[i]));
+        }
+    }
+}
+
+void VertexColorSums::resolve(std::vector<Vec3>& colors) const {
+    size_t n = std::min(colors.size(), count.size());
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    if (sampleKernelUsesAVX2()) {
+        resolveColorSumsAVX2(red.data(), green.data(), blue.data(), count.data(), n, colors.data());
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        if (count[i] > 0) {
+            colors[i] = Vec3(meanChannel(red[i], count[i]), meanChannel(green[i], count[i]),
+                             meanChannel(blue[i], count[i]));
+        }
+    }
+}
@@ -0,0 +1,1327 @@
+#include "include/colors.h"
+#include "include/sampling.h"
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// Texture of every material id, looked up by diffuse_texname once per pass so
+// face loops index a vector instead of searching the name map. nullptr stands
+// for materials colored with their flat diffuse color.
+std::vector<const Texture*> resolveMaterialTextures(const std::vector<tinyobj::material_t>& materials,
+                                                    const std::map<std::string, TexturePtr>& textures) {
+    std::vector<const Texture*> materialTextures(materials.size(), nullptr);
+    for (size_t m = 0; m < materials.size(); m++) {
+        auto textureIt = textures.find(materials[m].diffuse_texname);
+        if (textureIt != textures.end()) {
+            materialTextures[m] = textureIt->second.get();
+        }
+    }
+    return materialTextures;
+}
+
+// Texture lookups are grouped into square tiles of this many texels so each
+// bucket touches a few pages of the atlas.
+const int kSampleTileSize = 64;
+
+// One vertex color write of the color pass, kept in face order. Buckets at or
+// above the texture bucket count stand for flat material colors.
+struct SampleRequest {
+    uint32_t vertex;
+    uint32_t bucket;
+    float u, v;
+};
+
+// Texel tile hit by sampleTexture for these coordinates
+int sampleTileOf(const Texture& texture, float u, float v, int tilesX) {
+    u = std::fmod(u, 1.0f);
+    v = std::fmod(v, 1.0f);
+    if (u < 0) u += 1.0f;
+    if (v < 0) v += 1.0f;
+    int x = texture.storedX(static_cast<int>(u * (texture.uvWidth() - 1)));
+    int y = texture.storedY(static_cast<int>(v * (texture.uvHeight() - 1)));
+    return (y / kSampleTileSize) * tilesX + x / kSampleTileSize;
+}
+
+// Trilinear mip level for a texture sampled by this many vertices: each sample
+// then stands for about width * height / samples texels, whose side length is
+// the power of two the level divides the resolution by.
+float textureLod(const Texture& texture, size_t samples) {
+    if (samples == 0) {
+        return 0.0f;
+    }
+    double texelsPerSample = static_cast<double>(texture.width) * texture.height / static_cast<double>(samples);
+    return static_cast<float>(std::max(0.0, 0.5 * std::log2(texelsPerSample)));
+}
+
+// Per-material trilinear level, counting the corners of every material that
+// shares a texture towards that texture. All zero for the other filters.
+std::vector<float> materialTextureLods(const std::vector<tinyobj::shape_t>& shapes,
+                                       const std::vector<const Texture*>& materialTextures,
+                                       TextureFilter filter) {
+    std::vector<float> lods(materialTextures.size(), 0.0f);
+    if (filter != TextureFilter::Trilinear) {
+        return lods;
+    }
+    std::map<const Texture*, size_t> samples;
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            int materialId = shape.mesh.material_ids[f];
+            if (materialId >= 0 && materialId < static_cast<int>(materialTextures.size()) && materialTextures[materialId]) {
+                samples[materialTextures[materialId]] += shape.mesh.num_face_vertices[f];
+            }
+        }
+    }
+    for (size_t m = 0; m < materialTextures.size(); m++) {
+        if (materialTextures[m]) {
+            lods[m] = textureLod(*materialTextures[m], samples[materialTextures[m]]);
+        }
+    }
+    return lods;
+}
+
+// UV area attributed to each vertex: a 1/n share of the UV area of every
+// incident n-gon. Meaningful for sparse output where vertices are far apart
+// in texel terms.
+std::vector<float> vertexUvFootprints(const tinyobj::attrib_t& attrib,
+                                      const std::vector<tinyobj::shape_t>& shapes) {
+    std::vector<float> footprints(attrib.vertices.size() / 3, 0.0f);
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            // Shoelace formula over the face's texture coordinates
+            double area = 0.0;
+            bool complete = true;
+            for (unsigned int v = 0; v < fv; v++) {
+                const tinyobj::index_t& a = shape.mesh.indices[f * fv + v];
+                const tinyobj::index_t& b = shape.mesh.indices[f * fv + (v + 1) % fv];
+                if (a.texcoord_index < 0 || b.texcoord_index < 0) {
+                    complete = false;
+                    break;
+                }
+                area += attrib.texcoords[2 * a.texcoord_index + 0] * attrib.texcoords[2 * b.texcoord_index + 1] -
+                        attrib.texcoords[2 * b.texcoord_index + 0] * attrib.texcoords[2 * a.texcoord_index + 1];
+            }
+            if (!complete || fv == 0) {
+                continue;
+            }
+            float share = static_cast<float>(std::fabs(area) * 0.5 / fv);
+            for (unsigned int v = 0; v < fv; v++) {
+                int vertex = shape.mesh.indices[f * fv + v].vertex_index;
+                if (vertex >= 0) {
+                    footprints[vertex] += share;
+                }
+            }
+        }
+    }
+    return footprints;
+}
+
+// Mean texture color over a footprint of footprintUv (UV units squared): the
+// mip level whose texels are as wide as the footprint, blended trilinearly.
+Vec3 sampleFootprint(const Texture& texture, float u, float v, float footprintUv) {
+    float texels = footprintUv * static_cast<float>(texture.width) * static_cast<float>(texture.height);
+    float lod = texels > 1.0f ? 0.5f * std::log2(texels) : 0.0f;
+    return sampleTextureFiltered(texture, u, v, TextureFilter::Trilinear, lod);
+}
+
+// Color pass that gathers every sample request first, counting-sorts the
+// textured ones by (texture, tile), samples each bucket sequentially and then
+// replays the writes in face order, so the result matches the file-order pass.
+// Offsets are only accumulated when vertexOffsets is sized to the vertices,
+// and classes only written when vertexClasses is.
+int sortedColorPass(const tinyobj::attrib_t& attrib,
+                    const std::vector<tinyobj::shape_t>& shapes,
+                    const std::vector<tinyobj::material_t>& materials,
+                    const std::vector<const Texture*>& materialTextures,
+                    const ColorPassOptions& options,
+                    const std::vector<Vec3>& vertexNormals,
+                    std::vector<Vec3>& vertexOffsets,
+                    const std::vector<uint8_t>& materialClasses,
+                    std::vector<uint8_t>& vertexClasses,
+                    std::vector<Vec3>& vertexColors) {
+    // Resolve each material's bucket range once
+    std::vector<uint32_t> bucketBase(materials.size(), 0);
+    std::vector<int> tilesX(materials.size(), 0);
+    std::vector<const Texture*> bucketTextures;
+    std::vector<float> bucketLods;
+    std::map<const Texture*, uint32_t> textureBase;
+    for (size_t m = 0; m < materials.size(); m++) {
+        if (!materialTextures[m]) {
+            continue;
+        }
+        const Texture& texture = *materialTextures[m];
+        tilesX[m] = (texture.width + kSampleTileSize - 1) / kSampleTileSize;
+        auto baseIt = textureBase.find(&texture);
+        if (baseIt == textureBase.end()) {
+            int tilesY = (texture.height + kSampleTileSize - 1) / kSampleTileSize;
+            baseIt = textureBase.insert(std::make_pair(&texture, static_cast<uint32_t>(bucketTextures.size()))).first;
+            bucketTextures.resize(bucketTextures.size() + tilesX[m] * tilesY, &texture);
+        }
+        bucketBase[m] = baseIt->second;
+    }
+    std::vector<float> lods = materialTextureLods(shapes, materialTextures, options.filter);
+    bucketLods.resize(bucketTextures.size(), 0.0f);
+    for (size_t m = 0; m < materials.size(); m++) {
+        if (materialTextures[m]) {
+            const Texture& texture = *materialTextures[m];
+            int tilesY = (texture.height + kSampleTileSize - 1) / kSampleTileSize;
+            std::fill(bucketLods.begin() + bucketBase[m], bucketLods.begin() + bucketBase[m] + tilesX[m] * tilesY, lods[m]);
+        }
+    }
+    const uint32_t bucketCount = static_cast<uint32_t>(bucketTextures.size());
+
+    size_t cornerCount = 0;
+    for (const auto& shape : shapes) {
+        cornerCount += shape.mesh.indices.size();
+    }
+    std::vector<SampleRequest> requests;
+    requests.reserve(cornerCount);
+    // Class of each request's material, when classifying
+    std::vector<uint8_t> requestClasses;
+    std::vector<uint32_t> bucketStart(bucketCount + 1, 0);
+
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+
+            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                std::cout << "Invalid material ID: " << materialId << std::endl;
+                continue;
+            }
+
+            const Texture* texture = materialTextures[materialId];
+
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                SampleRequest request;
+                request.vertex = static_cast<uint32_t>(idx.vertex_index);
+                request.u = request.v = 0.0f;
+                if (!texture) {
+                    request.bucket = bucketCount + static_cast<uint32_t>(materialId);
+                    requests.push_back(request);
+                    if (!vertexClasses.empty()) {
+                        requestClasses.push_back(materialClasses[materialId]);
+                    }
+                    continue;
+                }
+                if (idx.texcoord_index < 0 || idx.vertex_index < 0) {
+                    std::cout << "Invalid index encountered: vertex_index=" << idx.vertex_index
+                              << ", texcoord_index=" << idx.texcoord_index << std::endl;
+                    continue;
+                }
+                request.u = attrib.texcoords[2 * idx.texcoord_index + 0];
+                // Flip V coordinate
+                request.v = 1.0f - static_cast<float>(attrib.texcoords[2 * idx.texcoord_index + 1]);
+                request.bucket = bucketBase[materialId] + sampleTileOf(*texture, request.u, request.v, tilesX[materialId]);
+                bucketStart[request.bucket + 1]++;
+                requests.push_back(request);
+                if (!vertexClasses.empty()) {
+                    requestClasses.push_back(materialClasses[materialId]);
+                }
+            }
+        }
+    }
+
+    // Counting sort of the textured requests by bucket into compact arrays,
+    // so the sampling loop below streams through them
+    for (uint32_t b = 0; b < bucketCount; b++) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    size_t texturedCount = bucketStart[bucketCount];
+    std::vector<float> sortedU(texturedCount), sortedV(texturedCount);
+    std::vector<uint32_t> sortedRequest(texturedCount);
+    {
+        std::vector<uint32_t> cursor(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t r = 0; r < requests.size(); r++) {
+            const SampleRequest& request = requests[r];
+            if (request.bucket >= bucketCount) {
+                continue;
+            }
+            uint32_t slot = cursor[request.bucket]++;
+            sortedU[slot] = request.u;
+            sortedV[slot] = request.v;
+            sortedRequest[slot] = static_cast<uint32_t>(r);
+        }
+    }
+
+    // Each bucket is one batch on a single texture, linearized right away
+    const ColorTransfer transfer(options.transfer);
+    std::vector<Vec3> sortedColors(texturedCount);
+    if (options.footprintColors) {
+        std::vector<float> footprints = vertexUvFootprints(attrib, shapes);
+        for (uint32_t b = 0; b < bucketCount; b++) {
+            for (uint32_t k = bucketStart[b]; k < bucketStart[b + 1]; k++) {
+                float footprint = footprints[requests[sortedRequest[k]].vertex];
+                sortedColors[k] = transfer.linearize(sampleFootprint(*bucketTextures[b], sortedU[k], sortedV[k], footprint));
+            }
+        }
+    } else if (options.filter == TextureFilter::Nearest) {
+        std::vector<uint32_t> texels(texturedCount);
+        for (uint32_t b = 0; b < bucketCount; b++) {
+            sampleTexelBatch(*bucketTextures[b], &sortedU[0] + bucketStart[b], &sortedV[0] + bucketStart[b],
+                             bucketStart[b + 1] - bucketStart[b], &texels[0] + bucketStart[b]);
+        }
+        for (size_t k = 0; k < texturedCount; k++) {
+            sortedColors[k] = transfer.texelColor(texels[k]);
+        }
+    } else {
+        for (uint32_t b = 0; b < bucketCount; b++) {
+            sampleTextureBatch(*bucketTextures[b], &sortedU[0] + bucketStart[b], &sortedV[0] + bucketStart[b],
+                               bucketStart[b + 1] - bucketStart[b], &sortedColors[0] + bucketStart[b],
+                               options.filter, bucketLods[b]);
+        }
+        for (size_t k = 0; k < texturedCount; k++) {
+            sortedColors[k] = transfer.linearize(sortedColors[k]);
+        }
+    }
+
+    std::vector<Vec3> sampledColors(requests.size());
+    for (size_t k = 0; k < texturedCount; k++) {
+        sampledColors[sortedRequest[k]] = sortedColors[k];
+    }
+
+    // Scatter in face order so the last face touching a vertex still wins,
+    // or sum every face's color when averaging
+    VertexColorSums sums(options.averageColors ? vertexColors.size() : 0);
+    const float offsetMagnitude = 0.0001f;
+    int texturedVertices = 0;
+    for (size_t r = 0; r < requests.size(); r++) {
+        const SampleRequest& request = requests[r];
+        if (!vertexClasses.empty()) {
+            vertexClasses[request.vertex] = requestClasses[r];
+        }
+        if (request.bucket >= bucketCount) {
+            const auto& material = materials[request.bucket - bucketCount];
+            Vec3 materialColor(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+            if (options.averageColors) {
+                sums.add(request.vertex, materialColor);
+            } else {
+                vertexColors[request.vertex] = materialColor;
+            }
+            continue;
+        }
+        if (options.averageColors) {
+            sums.add(request.vertex, sampledColors[r]);
+        } else {
+            vertexColors[request.vertex] = sampledColors[r];
+        }
+        texturedVertices++;
+        if (!vertexOffsets.empty()) {
+            const Vec3& normal = vertexNormals[request.vertex];
+            vertexOffsets[request.vertex].x += normal.x * offsetMagnitude;
+            vertexOffsets[request.vertex].y += normal.y * offsetMagnitude;
+            vertexOffsets[request.vertex].z += normal.z * offsetMagnitude;
+        }
+    }
+    if (options.averageColors) {
+        sums.resolve(vertexColors);
+    }
+    return texturedVertices;
+}
+
+// Linear color of one textured corner: the footprint mean, a table lookup of
+// the nearest texel or a filtered sample
+Vec3 texturedCornerColor(const Texture& texture, float u, float v, const ColorPassOptions& options,
+                         const ColorTransfer& transfer, float lod, float footprint) {
+    if (options.footprintColors) {
+        return transfer.linearize(sampleFootprint(texture, u, v, footprint));
+    }
+    if (options.filter == TextureFilter::Nearest) {
+        return transfer.texelColor(nearestTexel(texture, u, v));
+    }
+    return transfer.linearize(sampleTextureFiltered(texture, u, v, options.filter, lod));
+}
+
+// Adds texturedCornerColor to a vertex's sums, nearest texels straight from
+// the fixed-point table
+void addTexturedCornerColor(VertexColorSums& sums, size_t vertex, const Texture& texture, float u, float v,
+                            const ColorPassOptions& options, const ColorTransfer& transfer, float lod, float footprint) {
+    if (options.filter == TextureFilter::Nearest && !options.footprintColors) {
+        sums.addTexel(vertex, nearestTexel(texture, u, v), transfer);
+    } else {
+        sums.add(vertex, texturedCornerColor(texture, u, v, options, transfer, lod, footprint));
+    }
+}
+
+// Worker count for threadCount (0 = one per core), never more than there are items
+unsigned int colorWorkerCount(unsigned int threadCount, size_t items) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threadCount, items)));
+}
+
+// Runs task(worker, begin, end) on workerCount contiguous ranges of
+// [0, count), the calling thread taking the first one
+void runColorWorkers(size_t count, unsigned int workerCount,
+                     const std::function<void(unsigned int, size_t, size_t)>& task) {
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < workerCount; t++) {
+        workers.push_back(std::thread(task, t, count * t / workerCount, count * (t + 1) / workerCount));
+    }
+    task(0, 0, count / workerCount);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// What a corner does to its vertex's color in the file-order pass
+enum CornerWrite : uint8_t {
+    kCornerNoColor = 0,
+    kCornerFlatColor = 1,
+    kCornerTextureColor = 2
+};
+
+// Every corner of the mesh grouped by vertex (CSR), each vertex's corners in
+// face order. Workers owning disjoint vertex ranges can then replay exactly
+// the accumulations and overwrites the serial face loops do, without locks.
+struct VertexCorners {
+    // Corners of vertex v are [start[v], start[v + 1])
+    std::vector<uint32_t> start;
+    // Face (numbered across shapes) and texcoord index of each corner
+    std::vector<uint32_t> face;
+    std::vector<int32_t> texcoord;
+    std::vector<uint8_t> write;
+    // Shape, index within the shape and material of each face
+    std::vector<uint32_t> faceShape;
+    std::vector<uint32_t> faceIndex;
+    std::vector<int32_t> faceMaterial;
+};
+
+// Builds the corner lists with two counting passes. With report set, invalid
+// material ids and indices are logged in face order like the serial color
+// pass does.
+VertexCorners buildVertexCorners(const tinyobj::attrib_t& attrib,
+                                 const std::vector<tinyobj::shape_t>& shapes,
+                                 const std::vector<tinyobj::material_t>& materials,
+                                 const std::vector<const Texture*>& materialTextures,
+                                 bool report) {
+    VertexCorners corners;
+    const size_t vertexCount = attrib.vertices.size() / 3;
+    corners.start.assign(vertexCount + 1, 0);
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            for (unsigned int v = 0; v < fv; v++) {
+                int vertex = shape.mesh.indices[f * fv + v].vertex_index;
+                if (vertex >= 0) {
+                    corners.start[vertex + 1]++;
+                }
+            }
+            corners.faceShape.push_back(static_cast<uint32_t>(&shape - &shapes[0]));
+            corners.faceIndex.push_back(static_cast<uint32_t>(f));
+            corners.faceMaterial.push_back(shape.mesh.material_ids[f]);
+        }
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        corners.start[v + 1] += corners.start[v];
+    }
+    corners.face.resize(corners.start[vertexCount]);
+    corners.texcoord.resize(corners.start[vertexCount]);
+    corners.write.resize(corners.start[vertexCount]);
+
+    std::vector<uint32_t> cursor(corners.start.begin(), corners.start.end() - 1);
+    uint32_t face = 0;
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++, face++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+            bool validMaterial = materialId >= 0 && materialId < static_cast<int>(materials.size());
+            if (!validMaterial && report) {
+                std::cout << "Invalid material ID: " << materialId << std::endl;
+            }
+            bool textured = validMaterial && materialTextures[materialId];
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                uint8_t write = !validMaterial ? kCornerNoColor : textured ? kCornerTextureColor : kCornerFlatColor;
+                if (textured && (idx.texcoord_index < 0 || idx.vertex_index < 0)) {
+                    if (report) {
+                        std::cout << "Invalid index encountered: vertex_index=" << idx.vertex_index
+                                  << ", texcoord_index=" << idx.texcoord_index << std::endl;
+                    }
+                    write = kCornerNoColor;
+                }
+                if (idx.vertex_index < 0) {
+                    continue;
+                }
+                uint32_t slot = cursor[idx.vertex_index]++;
+                corners.face[slot] = face;
+                corners.texcoord[slot] = idx.texcoord_index;
+                corners.write[slot] = write;
+            }
+        }
+    }
+    return corners;
+}
+
+// Stages the first three corner positions of faces [first, first + n) for
+// faceNormalBatch; faces with fewer corners take the origin for the missing
+// ones, like the scalar face normal. shape is advanced to the face's shape.
+void stageFaceCorners(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+                      const std::vector<size_t>& shapeFaceStart, size_t& shape, size_t first, size_t n,
+                      float* staged, size_t stride) {
+    const double* vertices = attrib.vertices.data();
+    for (size_t i = 0; i < n; i++) {
+        while (first + i >= shapeFaceStart[shape + 1]) {
+            shape++;
+        }
+        const tinyobj::mesh_t& mesh = shapes[shape].mesh;
+        size_t f = first + i - shapeFaceStart[shape];
+        unsigned int fv = static_cast<unsigned int>(mesh.num_face_vertices[f]);
+        const tinyobj::index_t* idx = &mesh.indices[0] + f * fv;
+        for (unsigned int c = 0; c < 3; c++) {
+            float* corner = staged + 3 * c * stride + i;
+            if (c < fv) {
+                const double* position = vertices + 3 * idx[c].vertex_index;
+                corner[0] = static_cast<float>(position[0]);
+                corner[stride] = static_cast<float>(position[1]);
+                corner[2 * stride] = static_cast<float>(position[2]);
+            } else {
+                corner[0] = corner[stride] = corner[2 * stride] = 0.0f;
+            }
+        }
+    }
+}
+
+void vec3Normalize(Vec3& v) {
+    float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (length > 0) {
+        v.x /= length;
+        v.y /= length;
+        v.z /= length;
+    }
+}
+
+// Unit normal of the plane through the first three corners of a face
+Vec3 faceNormalOf(const tinyobj::attrib_t& attrib, const tinyobj::mesh_t& mesh, size_t f) {
+    unsigned int fv = static_cast<unsigned int>(mesh.num_face_vertices[f]);
+    const tinyobj::index_t* corners = &mesh.indices[f * fv];
+    // Faces with fewer corners take the origin for the missing ones
+    Vec3 p[3];
+    for (unsigned int c = 0; c < 3; c++) {
+        if (c >= fv) {
+            break;
+        }
+        int vertex = corners[c].vertex_index;
+        p[c] = Vec3(static_cast<float>(attrib.vertices[3 * vertex + 0]),
+                    static_cast<float>(attrib.vertices[3 * vertex + 1]),
+                    static_cast<float>(attrib.vertices[3 * vertex + 2]));
+    }
+    Vec3 a(p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z);
+    Vec3 b(p[2].x - p[0].x, p[2].y - p[0].y, p[2].z - p[0].z);
+    Vec3 normal(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    vec3Normalize(normal);
+    return normal;
+}
+
+// Vertex normals: the normalized sum of each vertex's face normals in face
+// order. One worker runs the plain face loop, which beats staging corners
+// for the batch kernels when there is nothing to split. Several compute the
+// face normals on face ranges with faceNormalBatch, then each sums and
+// normalizes (normalizeBatch) its own vertices through corners. Both give
+// the same normals, bit for bit.
+std::vector<Vec3> vertexNormalPass(const tinyobj::attrib_t& attrib,
+                                   const std::vector<tinyobj::shape_t>& shapes,
+                                   const VertexCorners* corners,
+                                   unsigned int workerCount) {
+    std::vector<Vec3> vertexNormals(attrib.vertices.size() / 3, Vec3(0, 0, 0));
+    if (!corners || workerCount <= 1) {
+        for (const auto& shape : shapes) {
+            for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+                unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+                Vec3 faceNormal = faceNormalOf(attrib, shape.mesh, f);
+                // Accumulate face normal to vertex normals
+                for (unsigned int v = 0; v < fv; v++) {
+                    Vec3& normal = vertexNormals[shape.mesh.indices[f * fv + v].vertex_index];
+                    normal.x += faceNormal.x;
+                    normal.y += faceNormal.y;
+                    normal.z += faceNormal.z;
+                }
+            }
+        }
+        for (auto& normal : vertexNormals) {
+            vec3Normalize(normal);
+        }
+        return vertexNormals;
+    }
+
+    std::vector<size_t> shapeFaceStart(shapes.size() + 1, 0);
+    for (size_t s = 0; s < shapes.size(); s++) {
+        shapeFaceStart[s + 1] = shapeFaceStart[s] + shapes[s].mesh.num_face_vertices.size();
+    }
+    const size_t faceCount = shapeFaceStart[shapes.size()];
+    const size_t kBlock = 256;
+    auto stagingBatch = [&](std::vector<float>& staged) {
+        staged.resize(9 * kBlock);
+        FaceCornerBatch batch;
+        for (int c = 0; c < 3; c++) {
+            batch.x[c] = &staged[(3 * c + 0) * kBlock];
+            batch.y[c] = &staged[(3 * c + 1) * kBlock];
+            batch.z[c] = &staged[(3 * c + 2) * kBlock];
+        }
+        return batch;
+    };
+
+    std::vector<Vec3> faceNormals(faceCount);
+    runColorWorkers(faceCount, workerCount, [&](unsigned int, size_t begin, size_t end) {
+        std::vector<float> staged;
+        FaceCornerBatch batch = stagingBatch(staged);
+        size_t shape = std::upper_bound(shapeFaceStart.begin(), shapeFaceStart.end(), begin) - shapeFaceStart.begin() - 1;
+        for (size_t first = begin; first < end; first += kBlock) {
+            size_t n = std::min(kBlock, end - first);
+            stageFaceCorners(attrib, shapes, shapeFaceStart, shape, first, n, &staged[0], kBlock);
+            faceNormalBatch(batch, n, &faceNormals[first]);
+        }
+    });
+    runColorWorkers(vertexNormals.size(), workerCount, [&](unsigned int, size_t begin, size_t end) {
+        for (size_t vertex = begin; vertex < end; vertex++) {
+            Vec3& normal = vertexNormals[vertex];
+            for (uint32_t c = corners->start[vertex]; c < corners->start[vertex + 1]; c++) {
+                const Vec3& faceNormal = faceNormals[corners->face[c]];
+                normal.x += faceNormal.x;
+                normal.y += faceNormal.y;
+                normal.z += faceNormal.z;
+            }
+        }
+        normalizeBatch(&vertexNormals[0] + begin, end - begin);
+    });
+    return vertexNormals;
+}
+
+// File-order color pass on vertex ranges: every vertex takes the color of its
+// last writing corner (sampled once) and, when vertexOffsets is sized to the
+// vertices, accumulates one offset per textured corner, exactly as the serial
+// face loop leaves it. Likewise for the last corner's class when vertexClasses
+// is sized.
+int parallelColorPass(const tinyobj::attrib_t& attrib,
+                      const std::vector<tinyobj::shape_t>& shapes,
+                      const std::vector<tinyobj::material_t>& materials,
+                      const std::vector<const Texture*>& materialTextures,
+                      const ColorPassOptions& options,
+                      const VertexCorners& corners,
+                      unsigned int workerCount,
+                      const std::vector<Vec3>& vertexNormals,
+                      std::vector<Vec3>& vertexOffsets,
+                      const std::vector<uint8_t>& materialClasses,
+                      std::vector<uint8_t>& vertexClasses,
+                      std::vector<Vec3>& vertexColors) {
+    std::vector<float> lods = materialTextureLods(shapes, materialTextures, options.filter);
+    std::vector<float> footprints;
+    if (options.footprintColors) {
+        footprints = vertexUvFootprints(attrib, shapes);
+    }
+    const ColorTransfer transfer(options.transfer);
+    VertexColorSums sums(options.averageColors ? vertexColors.size() : 0);
+    const float offsetMagnitude = 0.0001f;
+    std::vector<int> texturedCounts(workerCount, 0);
+    // Sums of the vertex's corners when averaging; each worker only touches
+    // its own vertices' sums
+    auto addCornerColor = [&](uint32_t c, size_t vertex) {
+        int materialId = corners.faceMaterial[corners.face[c]];
+        if (corners.write[c] == kCornerFlatColor) {
+            const auto& material = materials[materialId];
+            sums.add(vertex, Vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]));
+            return;
+        }
+        float u = attrib.texcoords[2 * corners.texcoord[c] + 0];
+        // Flip V coordinate
+        float v = 1.0f - static_cast<float>(attrib.texcoords[2 * corners.texcoord[c] + 1]);
+        addTexturedCornerColor(sums, vertex, *materialTextures[materialId], u, v, options, transfer, lods[materialId],
+                               options.footprintColors ? footprints[vertex] : 0.0f);
+    };
+    runColorWorkers(vertexColors.size(), workerCount, [&](unsigned int worker, size_t begin, size_t end) {
+        int textured = 0;
+        for (size_t vertex = begin; vertex < end; vertex++) {
+            const uint32_t noCorner = UINT32_MAX;
+            uint32_t last = noCorner;
+            for (uint32_t c = corners.start[vertex]; c < corners.start[vertex + 1]; c++) {
+                if (corners.write[c] == kCornerNoColor) {
+                    continue;
+                }
+                last = c;
+                if (corners.write[c] == kCornerTextureColor) {
+                    textured++;
+                    if (!vertexOffsets.empty()) {
+                        const Vec3& normal = vertexNormals[vertex];
+                        vertexOffsets[vertex].x += normal.x * offsetMagnitude;
+                        vertexOffsets[vertex].y += normal.y * offsetMagnitude;
+                        vertexOffsets[vertex].z += normal.z * offsetMagnitude;
+                    }
+                }
+                if (options.averageColors) {
+                    addCornerColor(c, vertex);
+                }
+            }
+            if (last == noCorner) {
+                continue;
+            }
+            int materialId = corners.faceMaterial[corners.face[last]];
+            if (!vertexClasses.empty()) {
+                vertexClasses[vertex] = materialClasses[materialId];
+            }
+            if (options.averageColors) {
+                continue;
+            }
+            if (corners.write[last] == kCornerFlatColor) {
+                const auto& material = materials[materialId];
+                vertexColors[vertex] = Vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+                continue;
+            }
+            float u = attrib.texcoords[2 * corners.texcoord[last] + 0];
+            // Flip V coordinate
+            float v = 1.0f - static_cast<float>(attrib.texcoords[2 * corners.texcoord[last] + 1]);
+            vertexColors[vertex] = texturedCornerColor(*materialTextures[materialId], u, v, options, transfer,
+                                                       lods[materialId],
+                                                       options.footprintColors ? footprints[vertex] : 0.0f);
+        }
+        texturedCounts[worker] = textured;
+    });
+    if (options.averageColors) {
+        sums.resolve(vertexColors);
+    }
+    int texturedVertices = 0;
+    for (int count : texturedCounts) {
+        texturedVertices += count;
+    }
+    return texturedVertices;
+}
+
+// Set of packed (vertex, texcoord) keys with open addressing and linear
+// probing, each key holding the largest corner id inserted with it. Inserts
+// from several threads are lock-free; which slot a key ends up in can depend
+// on their interleaving, the stored keys and corners cannot.
+class CornerTable {
+public:
+    static const uint64_t kEmpty = UINT64_MAX;
+
+    // Room for up to maxKeys keys at a load factor of at most one half
+    explicit CornerTable(size_t maxKeys) : bits(4) {
+        while ((size_t(1) << bits) < 2 * maxKeys) {
+            bits++;
+        }
+        size_t capacity = size_t(1) << bits;
+        keys.reset(new std::atomic<uint64_t>[capacity]);
+        corners.reset(new std::atomic<uint64_t>[capacity]);
+        for (size_t slot = 0; slot < capacity; slot++) {
+            keys[slot].store(kEmpty, std::memory_order_relaxed);
+            corners[slot].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return size_t(1) << bits; }
+
+    void insert(uint64_t key, uint64_t corner) {
+        const size_t mask = capacity() - 1;
+        size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+        for (;;) {
+            uint64_t current = keys[slot].load(std::memory_order_acquire);
+            if (current == kEmpty && keys[slot].compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                current = key;
+            }
+            if (current == key) {
+                uint64_t stored = corners[slot].load(std::memory_order_relaxed);
+                while (stored < corner &&
+                       !corners[slot].compare_exchange_weak(stored, corner, std::memory_order_relaxed)) {
+                }
+                return;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    uint64_t keyAt(size_t slot) const { return keys[slot].load(std::memory_order_relaxed); }
+    uint64_t cornerAt(size_t slot) const { return corners[slot].load(std::memory_order_relaxed); }
+
+private:
+    int bits;
+    std::unique_ptr<std::atomic<uint64_t>[]> keys;
+    std::unique_ptr<std::atomic<uint64_t>[]> corners;
+};
+
+// Gives every vertex the class of the last valid face using it, as the color
+// passes do, for meshes whose colors need no face loop
+void classifyVertices(const std::vector<tinyobj::shape_t>& shapes, const std::vector<uint8_t>& materialClasses,
+                      std::vector<uint8_t>& vertexClasses) {
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+            if (materialId < 0 || materialId >= static_cast<int>(materialClasses.size())) {
+                continue;
+            }
+            for (unsigned int v = 0; v < fv; v++) {
+                int vertex = shape.mesh.indices[f * fv + v].vertex_index;
+                if (vertex >= 0) {
+                    vertexClasses[vertex] = materialClasses[materialId];
+                }
+            }
+        }
+    }
+}
+
+// Table key of a corner; corners without texcoords share the all-ones texcoord
+uint64_t cornerKey(int vertex, int texcoord) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(vertex)) << 32) | static_cast<uint32_t>(texcoord);
+}
+
+}  // namespace
+
+std::vector<Vec3> computeVertexNormals(const tinyobj::attrib_t& attrib,
+                                       const std::vector<tinyobj::shape_t>& shapes,
+                                       unsigned int threads) {
+    unsigned int workerCount = colorWorkerCount(threads, attrib.vertices.size() / 3);
+    if (workerCount <= 1) {
+        return vertexNormalPass(attrib, shapes, nullptr, 1);
+    }
+    // Only the corners' faces are used, so materials do not matter
+    VertexCorners corners = buildVertexCorners(attrib, shapes, std::vector<tinyobj::material_t>(),
+                                               std::vector<const Texture*>(), false);
+    return vertexNormalPass(attrib, shapes, &corners, workerCount);
+}
+
+unsigned int vertexGeometryStages(unsigned int requested) {
+    if (requested & kVertexOffsets) {
+        requested |= kVertexNormals;
+    }
+    return requested;
+}
+
+std::map<std::string, TextureUvBounds> computeTextureUvBounds(const tinyobj::attrib_t& attrib,
+                                                              const std::vector<tinyobj::shape_t>& shapes,
+                                                              const std::vector<tinyobj::material_t>& materials) {
+    std::vector<TextureUvBounds> materialBounds(materials.size());
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                continue;
+            }
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                if (idx.texcoord_index < 0) {
+                    continue;
+                }
+                float u = attrib.texcoords[2 * idx.texcoord_index + 0];
+                float v_cord = attrib.texcoords[2 * idx.texcoord_index + 1];
+                // Flip V coordinate like the color passes
+                v_cord = 1.0f - v_cord;
+                extendTextureUvBounds(materialBounds[materialId], u, v_cord);
+            }
+        }
+    }
+
+    std::map<std::string, TextureUvBounds> bounds;
+    for (size_t m = 0; m < materials.size(); m++) {
+        const std::string& name = materials[m].diffuse_texname;
+        if (name.empty() || materialBounds[m].empty()) {
+            continue;
+        }
+        auto inserted = bounds.insert(std::make_pair(name, materialBounds[m]));
+        if (!inserted.second) {
+            TextureUvBounds& merged = inserted.first->second;
+            merged.minU = std::min(merged.minU, materialBounds[m].minU);
+            merged.minV = std::min(merged.minV, materialBounds[m].minV);
+            merged.maxU = std::max(merged.maxU, materialBounds[m].maxU);
+            merged.maxV = std::max(merged.maxV, materialBounds[m].maxV);
+        }
+    }
+    return bounds;
+}
+
+std::map<std::string, size_t> computeTextureSampleCounts(const tinyobj::attrib_t& attrib,
+                                                         const std::vector<tinyobj::shape_t>& shapes,
+                                                         const std::vector<tinyobj::material_t>& materials) {
+    // The last face touching a vertex through a texcoord decides its color,
+    // like in the color passes
+    std::vector<int> vertexMaterial(attrib.vertices.size() / 3, -1);
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                continue;
+            }
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                if (idx.texcoord_index >= 0) {
+                    vertexMaterial[idx.vertex_index] = materialId;
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> materialSamples(materials.size(), 0);
+    for (int materialId : vertexMaterial) {
+        if (materialId >= 0) {
+            materialSamples[materialId]++;
+        }
+    }
+    std::map<std::string, size_t> samples;
+    for (size_t m = 0; m < materials.size(); m++) {
+        if (!materials[m].diffuse_texname.empty() && materialSamples[m] > 0) {
+            samples[materials[m].diffuse_texname] += materialSamples[m];
+        }
+    }
+    return samples;
+}
+
+std::vector<Vec3> computeVertexColorsFromTextures(
+    const tinyobj::attrib_t& attrib,
+    const std::vector<tinyobj::shape_t>& shapes,
+    const std::vector<tinyobj::material_t>& materials,
+    const std::map<std::string, TexturePtr>& textures,
+    const ColorPassOptions& options,
+    VertexGeometry* geometry) {
+
+    std::vector<Vec3> vertexColors(attrib.vertices.size() / 3, Vec3(1, 1, 1));
+    // Normals and offsets are only computed for the stages that consume them
+    unsigned int stages = geometry ? vertexGeometryStages(geometry->requested) : 0;
+    std::vector<Vec3> vertexNormals;
+    std::vector<Vec3> vertexOffsets;
+    if (stages & kVertexOffsets) {
+        vertexOffsets.assign(vertexColors.size(), Vec3(0, 0, 0));
+    }
+    std::vector<uint8_t> vertexClasses;
+    if (stages & kVertexClasses) {
+        vertexClasses.assign(vertexColors.size(), 0);
+    }
+    const std::vector<uint8_t> noClasses;
+    const std::vector<uint8_t>& materialClasses = (stages & kVertexClasses) ? geometry->materialClasses : noClasses;
+
+    if (attrib.texcoords.empty()) {
+        std::cout << "No texture coordinates found in the OBJ file." << std::endl;
+        if (stages & kVertexNormals) {
+            // No corner is textured, so offsets stay zero
+            geometry->normals = computeVertexNormals(attrib, shapes, options.threads);
+            geometry->offsets.swap(vertexOffsets);
+        }
+        if (stages & kVertexClasses) {
+            // No color pass runs, so classes come from a face loop of their own
+            classifyVertices(shapes, materialClasses, vertexClasses);
+            geometry->classes.swap(vertexClasses);
+        }
+        return vertexColors;
+    }
+
+    std::cout << "Number of shapes: " << shapes.size() << std::endl;
+    std::cout << "Number of materials: " << materials.size() << std::endl;
+    std::cout << "Number of textures: " << textures.size() << std::endl;
+
+    int texturedVertices = 0;
+    std::vector<const Texture*> materialTextures = resolveMaterialTextures(materials, textures);
+
+    // Several workers own vertex ranges of the normal pass and the file-order
+    // color pass, which then need every vertex's corners grouped up front
+    unsigned int workerCount = colorWorkerCount(options.threads, vertexColors.size());
+    VertexCorners corners;
+    if (workerCount > 1) {
+        // The sorted pass reports invalid faces itself
+        corners = buildVertexCorners(attrib, shapes, materials, materialTextures, !options.sortedSampling);
+    }
+
+    // First pass: compute vertex normals, when a stage needs them
+    if (stages & kVertexNormals) {
+        vertexNormals = vertexNormalPass(attrib, shapes, workerCount > 1 ? &corners : nullptr, workerCount);
+    }
+
+    // Second pass: compute colors and store offsets
+    const float offsetMagnitude = 0.0001f; // Adjust this value as needed
+
+    if (options.sortedSampling) {
+        texturedVertices = sortedColorPass(attrib, shapes, materials, materialTextures, options,
+                                           vertexNormals, vertexOffsets, materialClasses, vertexClasses,
+                                           vertexColors);
+    } else if (workerCount > 1) {
+        texturedVertices = parallelColorPass(attrib, shapes, materials, materialTextures, options, corners,
+                                             workerCount, vertexNormals, vertexOffsets, materialClasses,
+                                             vertexClasses, vertexColors);
+    } else {
+        std::vector<float> lods = materialTextureLods(shapes, materialTextures, options.filter);
+        const ColorTransfer transfer(options.transfer);
+        std::vector<float> footprints;
+        if (options.footprintColors) {
+            footprints = vertexUvFootprints(attrib, shapes);
+        }
+        VertexColorSums sums(options.averageColors ? vertexColors.size() : 0);
+
+        for (const auto& shape : shapes) {
+            for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+                unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+                int materialId = shape.mesh.material_ids[f];
+
+                if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                    std::cout << "Invalid material ID: " << materialId << std::endl;
+                    continue;
+                }
+
+                const Texture* texturePtr = materialTextures[materialId];
+
+                if (!texturePtr) {
+                    const auto& material = materials[materialId];
+                    Vec3 materialColor(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+                    for (unsigned int v = 0; v < fv; v++) {
+                        tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                        if (options.averageColors) {
+                            sums.add(idx.vertex_index, materialColor);
+                        } else {
+                            vertexColors[idx.vertex_index] = materialColor;
+                        }
+                        if (stages & kVertexClasses) {
+                            vertexClasses[idx.vertex_index] = materialClasses[materialId];
+                        }
+                    }
+                    continue;
+                }
+
+                const Texture& texture = *texturePtr;
+
+                for (unsigned int v = 0; v < fv; v++) {
+                    tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                    if (idx.texcoord_index < 0 || idx.vertex_index < 0) {
+                        std::cout << "Invalid index encountered: vertex_index=" << idx.vertex_index
+                                  << ", texcoord_index=" << idx.texcoord_index << std::endl;
+                        continue;
+                    }
+
+                    float u = attrib.texcoords[2 * idx.texcoord_index + 0];
+                    float v_cord = attrib.texcoords[2 * idx.texcoord_index + 1];
+
+                    // Flip V coordinate
+                    v_cord = 1.0f - v_cord;
+
+                    // Apply gamma correction, with a table lookup for plain texels
+                    float footprint = options.footprintColors ? footprints[idx.vertex_index] : 0.0f;
+                    if (options.averageColors) {
+                        addTexturedCornerColor(sums, idx.vertex_index, texture, u, v_cord, options, transfer,
+                                               lods[materialId], footprint);
+                    } else {
+                        vertexColors[idx.vertex_index] =
+                            texturedCornerColor(texture, u, v_cord, options, transfer, lods[materialId], footprint);
+                    }
+                    if (stages & kVertexClasses) {
+                        vertexClasses[idx.vertex_index] = materialClasses[materialId];
+                    }
+                    texturedVertices++;
+
+                    // Store offset along vertex normal
+                    if (stages & kVertexOffsets) {
+                        Vec3& normal = vertexNormals[idx.vertex_index];
+                        vertexOffsets[idx.vertex_index].x += normal.x * offsetMagnitude;
+                        vertexOffsets[idx.vertex_index].y += normal.y * offsetMagnitude;
+                        vertexOffsets[idx.vertex_index].z += normal.z * offsetMagnitude;
+                    }
+                }
+            }
+        }
+        if (options.averageColors) {
+            sums.resolve(vertexColors);
+        }
+    }
+
+    std::cout << "Total textured vertices: " << texturedVertices << " out of " << vertexColors.size() << std::endl;
+
+    if (stages) {
+        geometry->normals.swap(vertexNormals);
+        geometry->offsets.swap(vertexOffsets);
+        geometry->classes.swap(vertexClasses);
+    }
+    return vertexColors;
+}
+
+std::vector<Vec3> computeVertexColorsByMaterial(
+    const tinyobj::attrib_t& attrib,
+    const std::vector<tinyobj::shape_t>& shapes,
+    const std::vector<tinyobj::material_t>& materials,
+    const MaterialTextureLoader& loadMaterialTexture,
+    const ColorPassOptions& options) {
+
+    std::vector<Vec3> vertexColors(attrib.vertices.size() / 3, Vec3(1, 1, 1));
+
+    if (attrib.texcoords.empty()) {
+        std::cout << "No texture coordinates found in the OBJ file." << std::endl;
+        return vertexColors;
+    }
+
+    struct FaceRef {
+        uint32_t shape;
+        uint32_t face;
+        uint64_t firstCorner;
+    };
+
+    // Face-order id of the last corner that writes each vertex. Only that
+    // corner is colored later, so the group order does not change the result.
+    const uint64_t kNoWriter = UINT64_MAX;
+    std::vector<uint64_t> lastWriter(vertexColors.size(), kNoWriter);
+    std::vector<size_t> groupStart(materials.size() + 1, 0);
+    // Corners sampling each texture, for the trilinear level
+    std::map<std::string, size_t> textureSamples;
+    uint64_t corner = 0;
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = shape.mesh.material_ids[f];
+            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                std::cout << "Invalid material ID: " << materialId << std::endl;
+                corner += fv;
+                continue;
+            }
+            bool textured = !materials[materialId].diffuse_texname.empty();
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
+                if (idx.vertex_index < 0 || (textured && idx.texcoord_index < 0)) {
+                    std::cout << "Invalid index encountered: vertex_index=" << idx.vertex_index
+                              << ", texcoord_index=" << idx.texcoord_index << std::endl;
+                    continue;
+                }
+                lastWriter[idx.vertex_index] = corner + v;
+            }
+            groupStart[materialId + 1]++;
+            if (textured) {
+                textureSamples[materials[materialId].diffuse_texname] += fv;
+            }
+            corner += fv;
+        }
+    }
+
+    // Bucket faces by material
+    for (size_t m = 0; m < materials.size(); m++) {
+        groupStart[m + 1] += groupStart[m];
+    }
+    std::vector<FaceRef> faces(groupStart[materials.size()]);
+    {
+        std::vector<size_t> cursor(groupStart.begin(), groupStart.end() - 1);
+        corner = 0;
+        for (size_t s = 0; s < shapes.size(); s++) {
+            const auto& mesh = shapes[s].mesh;
+            for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+                int materialId = mesh.material_ids[f];
+                if (materialId >= 0 && materialId < static_cast<int>(materials.size())) {
+                    FaceRef ref = {static_cast<uint32_t>(s), static_cast<uint32_t>(f), corner};
+                    faces[cursor[materialId]++] = ref;
+                }
+                corner += mesh.num_face_vertices[f];
+            }
+        }
+    }
+
+    std::vector<float> footprints;
+    if (options.footprintColors) {
+        footprints = vertexUvFootprints(attrib, shapes);
+    }
+
+    // Materials sharing a texture run back to back, so it stays cached between them
+    std::vector<size_t> materialOrder(materials.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        materialOrder[m] = m;
+    }
+    std::stable_sort(materialOrder.begin(), materialOrder.end(), [&](size_t a, size_t b) {
+        return materials[a].diffuse_texname < materials[b].diffuse_texname;
+    });
+
+    const ColorTransfer transfer(options.transfer);
+    VertexColorSums sums(options.averageColors ? vertexColors.size() : 0);
+    int texturedVertices = 0;
+    size_t groups = 0;
+    for (size_t m : materialOrder) {
+        if (groupStart[m] == groupStart[m + 1]) {
+            continue;
+        }
+        groups++;
+        const auto& material = materials[m];
+        TexturePtr texture;
+        if (!material.diffuse_texname.empty()) {
+            texture = loadMaterialTexture(m);
+        }
+        Vec3 materialColor(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+        float lod = 0.0f;
+        if (texture && options.filter == TextureFilter::Trilinear) {
+            lod = textureLod(*texture, textureSamples[material.diffuse_texname]);
+        }
+
+        for (size_t i = groupStart[m]; i < groupStart[m + 1]; i++) {
+            const FaceRef& ref = faces[i];
+            const auto& mesh = shapes[ref.shape].mesh;
+            unsigned int fv = static_cast<unsigned int>(mesh.num_face_vertices[ref.face]);
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = mesh.indices[ref.face * fv + v];
+                if (idx.vertex_index < 0) {
+                    continue;
+                }
+                if (options.averageColors) {
+                    // Every corner that writes the vertex in face order counts
+                    if (!material.diffuse_texname.empty() && idx.texcoord_index < 0) {
+                        continue;
+                    }
+                } else if (lastWriter[idx.vertex_index] != ref.firstCorner + v) {
+                    continue;
+                }
+                if (!texture) {
+                    if (options.averageColors) {
+                        sums.add(idx.vertex_index, materialColor);
+                    } else {
+                        vertexColors[idx.vertex_index] = materialColor;
+                    }
+                    continue;
+                }
+
+                float u = attrib.texcoords[2 * idx.texcoord_index + 0];
+                float v_cord = attrib.texcoords[2 * idx.texcoord_index + 1];
+
+                // Flip V coordinate
+                v_cord = 1.0f - v_cord;
+
+                // Apply gamma correction, with a table lookup for plain texels
+                float footprint = options.footprintColors ? footprints[idx.vertex_index] : 0.0f;
+                if (options.averageColors) {
+                    addTexturedCornerColor(sums, idx.vertex_index, *texture, u, v_cord, options, transfer, lod,
+                                           footprint);
+                } else {
+                    vertexColors[idx.vertex_index] = texturedCornerColor(*texture, u, v_cord, options, transfer, lod,
+                                                                         footprint);
+                }
+                texturedVertices++;
+            }
+        }
+    }
+    if (options.averageColors) {
+        sums.resolve(vertexColors);
+    }
+
+    std::cout << "Colored " << groups << " material groups, " << texturedVertices
+              << " textured vertices out of " << vertexColors.size() << std::endl;
+
+    return vertexColors;
+}
+
+CornerPoints computeCornerPointColors(const tinyobj::attrib_t& attrib,
+                                      const std::vector<tinyobj::shape_t>& shapes,
+                                      const std::vector<tinyobj::material_t>& materials,
+                                      const std::map<std::string, TexturePtr>& textures,
+                                      const ColorPassOptions& options) {
+    const size_t vertexCount = attrib.vertices.size() / 3;
+    // Faces are numbered across shapes; corner ids are face << 16 | corner
+    // in face, which grows in face order
+    std::vector<size_t> shapeFaceStart(shapes.size() + 1, 0);
+    size_t cornerCount = 0;
+    for (size_t s = 0; s < shapes.size(); s++) {
+        shapeFaceStart[s + 1] = shapeFaceStart[s] + shapes[s].mesh.num_face_vertices.size();
+        cornerCount += shapes[s].mesh.indices.size();
+    }
+    const size_t faceCount = shapeFaceStart[shapes.size()];
+    auto faceShape = [&](size_t face) {
+        return static_cast<size_t>(std::upper_bound(shapeFaceStart.begin(), shapeFaceStart.end(), face) -
+                                   shapeFaceStart.begin() - 1);
+    };
+
+    // Distinct (vertex, texcoord) pairs, keyed to the last corner using them
+    unsigned int workerCount = colorWorkerCount(options.threads, faceCount);
+    CornerTable table(cornerCount);
+    runColorWorkers(faceCount, workerCount, [&](unsigned int, size_t begin, size_t end) {
+        if (begin == end) {
+            return;
+        }
+        size_t s = faceShape(begin);
+        for (size_t face = begin; face < end; face++) {
+            while (face >= shapeFaceStart[s + 1]) {
+                s++;
+            }
+            const tinyobj::mesh_t& mesh = shapes[s].mesh;
+            size_t f = face - shapeFaceStart[s];
+            unsigned int fv = static_cast<unsigned int>(mesh.num_face_vertices[f]);
+            for (unsigned int v = 0; v < fv; v++) {
+                tinyobj::index_t idx = mesh.indices[f * fv + v];
+                if (idx.vertex_index >= 0) {
+                    table.insert(cornerKey(idx.vertex_index, idx.texcoord_index), (static_cast<uint64_t>(face) << 16) | v);
+                }
+            }
+        }
+    });
+
+    struct Entry {
+        uint64_t key;
+        uint64_t corner;
+        bool operator<(const Entry& other) const { return key < other.key; }
+    };
+    std::vector<Entry> entries;
+    for (size_t slot = 0; slot < table.capacity(); slot++) {
+        if (table.keyAt(slot) != CornerTable::kEmpty) {
+            Entry entry = {table.keyAt(slot), table.cornerAt(slot)};
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    // Merge in the vertices no face uses, keeping the vertex order
+    const uint64_t kLooseVertex = UINT64_MAX;
+    CornerPoints points;
+    std::vector<uint64_t> pointCorners;
+    points.vertices.reserve(entries.size());
+    size_t next = 0;
+    for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        bool used = false;
+        while (next < entries.size() && (entries[next].key >> 32) == vertex) {
+            points.vertices.push_back(static_cast<uint32_t>(vertex));
+            pointCorners.push_back(entries[next].corner);
+            next++;
+            used = true;
+        }
+        if (!used) {
+            points.vertices.push_back(static_cast<uint32_t>(vertex));
+            pointCorners.push_back(kLooseVertex);
+        }
+    }
+    std::cout << "Split " << vertexCount << " vertices into " << points.vertices.size() << " points at UV seams"
+              << std::endl;
+
+    // Color each point from its own corner
+    std::vector<const Texture*> materialTextures = resolveMaterialTextures(materials, textures);
+    std::vector<float> lods = materialTextureLods(shapes, materialTextures, options.filter);
+    std::vector<float> footprints;
+    if (options.footprintColors) {
+        footprints = vertexUvFootprints(attrib, shapes);
+    }
+    const ColorTransfer transfer(options.transfer);
+    points.colors.assign(points.vertices.size(), Vec3(1, 1, 1));
+    runColorWorkers(points.vertices.size(), colorWorkerCount(options.threads, points.vertices.size()),
+                    [&](unsigned int, size_t begin, size_t end) {
+        for (size_t point = begin; point < end; point++) {
+            if (pointCorners[point] == kLooseVertex) {
+                continue;
+            }
+            size_t face = static_cast<size_t>(pointCorners[point] >> 16);
+            unsigned int v = static_cast<unsigned int>(pointCorners[point] & 0xFFFF);
+            size_t s = faceShape(face);
+            const tinyobj::mesh_t& mesh = shapes[s].mesh;
+            size_t f = face - shapeFaceStart[s];
+            int materialId = mesh.material_ids[f];
+            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
+                continue;
+            }
+            if (!materialTextures[materialId]) {
+                const auto& material = materials[materialId];
+                points.colors[point] = Vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+                continue;
+            }
+            tinyobj::index_t idx = mesh.indices[f * mesh.num_face_vertices[f] + v];
+            if (idx.texcoord_index < 0) {
+                continue;
+            }
+            float u = attrib.texcoords[2 * idx.texcoord_index + 0];
+            // Flip V coordinate
+            float vCoord = 1.0f - static_cast<float>(attrib.texcoords[2 * idx.texcoord_index + 1]);
+            points.colors[point] = texturedCornerColor(*materialTextures[materialId], u, vCoord, options, transfer,
+                                                       lods[materialId],
+                                                       options.footprintColors ? footprints[idx.vertex_index] : 0.0f);
+        }
+    });
+    return points;
+}
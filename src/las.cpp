@@ -4,9 +4,9 @@
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
-#include <iomanip>
 #include "las.h"
 #include <limits>
+#include <cmath>
 
 void LAS13Writer::initializeHeader() {
     std::memset(&header, 0, sizeof(LASHeader));
@@ -63,33 +63,107 @@ void LAS13Writer::writeHeader() {
     }
 }
 
+void LAS13Writer::writeExtraBytesRecord() {
+    const char* names[3] = {"NormalX", "NormalY", "NormalZ"};
+    LASVariableLengthRecordHeader record;
+    std::memset(&record, 0, sizeof(record));
+    std::memcpy(record.userID, "LASF_Spec", 9);
+    record.recordID = 4;
+    record.recordLengthAfterHeader = 3 * sizeof(LASExtraBytesDescriptor);
+    std::memcpy(record.description, "Vertex normals", 14);
+
+    LASExtraBytesDescriptor fields[3];
+    std::memset(fields, 0, sizeof(fields));
+    for (int axis = 0; axis < 3; axis++) {
+        LASExtraBytesDescriptor& field = fields[axis];
+        std::memcpy(field.name, names[axis], std::strlen(names[axis]));
+        if (normalFormat == LASNormalFormat::Int16) {
+            field.dataType = 4;  // short
+            field.options = 0x08;  // scale is set
+            field.scale[0] = 1.0 / 32767.0;
+        } else {
+            field.dataType = 9;  // float
+        }
+        std::memcpy(field.description, "Unit vertex normal component", 28);
+    }
+
+    file.seekp(header.headerSize);
+    file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    file.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+    if (file.fail()) {
+        throw std::runtime_error("Failed to write the Extra Bytes record");
+    }
+}
+
 void LAS13Writer::writePoints() {
-    file.seekp(header.offsetToPointData);
+    if (pointBuffer.empty()) {
+        return;
+    }
+    file.seekp(header.offsetToPointData + bytesWritten);
     file.write(pointBuffer.data(), pointBuffer.size());
     if (file.fail()) {
         throw std::runtime_error("Failed to write point data");
     }
+    bytesWritten += pointBuffer.size();
+    pointBuffer.clear();
 }
 
-bool LAS13Writer::open(const std::string& fname) {
+bool LAS13Writer::open(const std::string& fname, LASNormalFormat normals) {
     filename = fname;
     file.open(filename, std::ios::binary | std::ios::trunc);
     if (!file.is_open()) {
         return false;
     }
     initializeHeader();
+    normalFormat = normals;
+    if (normalFormat != LASNormalFormat::None) {
+        header.numberOfVariableLengthRecords = 1;
+        header.offsetToPointData = header.headerSize + sizeof(LASVariableLengthRecordHeader) +
+                                   3 * sizeof(LASExtraBytesDescriptor);
+        header.pointDataRecordLength += normalFormat == LASNormalFormat::Int16 ? 3 * 2 : 3 * 4;
+    }
+    bytesWritten = 0;
+    pointBuffer.clear();
+    pointBuffer.reserve(flushThreshold);
+    // Reserve space for the header, it is rewritten with final bounds on close()
+    writeHeader();
+    if (normalFormat != LASNormalFormat::None) {
+        writeExtraBytesRecord();
+    }
     return true;
 }
 
 
+// Extra bytes of one normal component in the file's format
+static inline void packNormal(char* field, float value, LASNormalFormat format) {
+    if (format == LASNormalFormat::Float32) {
+        std::memcpy(field, &value, 4);
+    } else {
+        float clamped = std::min(std::max(value, -1.0f), 1.0f);
+        int16_t packed = static_cast<int16_t>(std::lround(clamped * 32767.0f));
+        std::memcpy(field, &packed, 2);
+    }
+}
+
 void LAS13Writer::addPointColor(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b) {
+    appendPoint(x, y, z, r, g, b, nullptr);
+}
+
+void LAS13Writer::addPointColorNormal(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b,
+                                      float nx, float ny, float nz) {
+    const float normal[3] = {nx, ny, nz};
+    appendPoint(x, y, z, r, g, b, normal);
+}
+
+void LAS13Writer::appendPoint(double x, double y, double z, uint16_t r, uint16_t g, uint16_t b,
+                              const float* normal) {
     updateHeaderBounds(x, y, z);
     
     int32_t ix = static_cast<int32_t>((x - header.xOffset) / header.xScaleFactor);
     int32_t iy = static_cast<int32_t>((y - header.yOffset) / header.yScaleFactor);
     int32_t iz = static_cast<int32_t>((z - header.zOffset) / header.zScaleFactor);
 
-    char point[34] = {0};  // Initialize to zero
+    char point[34 + 12] = {0};  // Initialize to zero
     std::memcpy(point, &ix, 4);
     std::memcpy(point + 4, &iy, 4);
     std::memcpy(point + 8, &iz, 4);
@@ -99,15 +173,79 @@ void LAS13Writer::addPointColor(double x, double y, double z, uint16_t r, uint16
     std::memcpy(point + 28, &r, 2);
     std::memcpy(point + 30, &g, 2);
     std::memcpy(point + 32, &b, 2);
+    // Extra bytes: the normal, or zeros for points added without one
+    if (normal && normalFormat != LASNormalFormat::None) {
+        size_t normalBytes = normalFormat == LASNormalFormat::Float32 ? 4 : 2;
+        for (int axis = 0; axis < 3; axis++) {
+            packNormal(point + 34 + axis * normalBytes, normal[axis], normalFormat);
+        }
+    }
 
-    pointBuffer.insert(pointBuffer.end(), point, point + 34);
+    pointBuffer.insert(pointBuffer.end(), point, point + header.pointDataRecordLength);
     header.numberOfPointRecords++;
+    // Stream points to disk in chunks instead of holding the whole cloud in memory
+    if (pointBuffer.size() >= flushThreshold) {
+        writePoints();
+    }
+}
+
+template <LASNormalFormat Normals>
+void LAS13Writer::encodePoints(const LASPointBatch& batch, char* records) {
+    const size_t recordLength = header.pointDataRecordLength;
+    const size_t normalBytes = Normals == LASNormalFormat::Float32 ? 4 : 2;
+    for (size_t i = 0; i < batch.count; i++) {
+        char* point = records + i * recordLength;
+        updateHeaderBounds(batch.x[i], batch.y[i], batch.z[i]);
+        int32_t ix = static_cast<int32_t>((batch.x[i] - header.xOffset) / header.xScaleFactor);
+        int32_t iy = static_cast<int32_t>((batch.y[i] - header.yOffset) / header.yScaleFactor);
+        int32_t iz = static_cast<int32_t>((batch.z[i] - header.zOffset) / header.zScaleFactor);
+        std::memcpy(point, &ix, 4);
+        std::memcpy(point + 4, &iy, 4);
+        std::memcpy(point + 8, &iz, 4);
+        if (batch.intensity) {
+            std::memcpy(point + 12, &batch.intensity[i], 2);
+        }
+        point[14] = 0x01;  // Return Number (1) and Number of Returns (1)
+        if (batch.classification) {
+            point[15] = static_cast<char>(batch.classification[i]);
+        }
+        std::memcpy(point + 28, &batch.red[i], 2);
+        std::memcpy(point + 30, &batch.green[i], 2);
+        std::memcpy(point + 32, &batch.blue[i], 2);
+        if (Normals != LASNormalFormat::None && batch.normalX) {
+            packNormal(point + 34, batch.normalX[i], Normals);
+            packNormal(point + 34 + normalBytes, batch.normalY[i], Normals);
+            packNormal(point + 34 + 2 * normalBytes, batch.normalZ[i], Normals);
+        }
+    }
+}
+
+void LAS13Writer::addPoints(const LASPointBatch& batch) {
+    // Records start zeroed, so fields the batch does not carry stay 0
+    size_t start = pointBuffer.size();
+    pointBuffer.resize(start + batch.count * header.pointDataRecordLength, 0);
+    char* records = pointBuffer.data() + start;
+    switch (normalFormat) {
+    case LASNormalFormat::None:
+        encodePoints<LASNormalFormat::None>(batch, records);
+        break;
+    case LASNormalFormat::Float32:
+        encodePoints<LASNormalFormat::Float32>(batch, records);
+        break;
+    case LASNormalFormat::Int16:
+        encodePoints<LASNormalFormat::Int16>(batch, records);
+        break;
+    }
+    header.numberOfPointRecords += static_cast<uint32_t>(batch.count);
+    if (pointBuffer.size() >= flushThreshold) {
+        writePoints();
+    }
 }
 
 void LAS13Writer::close() {
     try {
-        writeHeader();
         writePoints();
+        writeHeader();
         file.flush();
         if (file.fail()) {
             throw std::runtime_error("Failed to flush file buffer");
@@ -131,31 +269,23 @@ void LAS13Writer::close() {
         std::cerr << "Error in close(): " << e.what() << std::endl;
         throw;
     }
+}
 
-    // Debug prints
-    std::cout << "\nLAS File Header Information:" << std::endl;
-    std::cout << "File Signature: " << std::string(header.fileSignature, 4) << std::endl;
-    std::cout << "Version: " << (int)header.versionMajor << "." << (int)header.versionMinor << std::endl;
-    std::cout << "Header Size: " << header.headerSize << std::endl;
-    std::cout << "Point Data Record Format: " << (int)header.pointDataRecordFormat << std::endl;
-    std::cout << "Point Data Record Length: " << header.pointDataRecordLength << std::endl;
-    std::cout << "Number of Point Records: " << header.numberOfPointRecords << std::endl;
-    std::cout << "Scale Factors (X, Y, Z): " << header.xScaleFactor << ", " 
-              << header.yScaleFactor << ", " << header.zScaleFactor << std::endl;
-    std::cout << "Offset (X, Y, Z): " << header.xOffset << ", " 
-              << header.yOffset << ", " << header.zOffset << std::endl;
-    std::cout << "Min Bounds (X, Y, Z): " << header.minX << ", " 
-              << header.minY << ", " << header.minZ << std::endl;
-    std::cout << "Max Bounds (X, Y, Z): " << header.maxX << ", " 
-              << header.maxY << ", " << header.maxZ << std::endl;
-
-    std::cout << "\nPoint Data Size: " << pointBuffer.size() << " bytes" << std::endl;
-    std::cout << "Expected Point Data Size: " << header.numberOfPointRecords * header.pointDataRecordLength << " bytes" << std::endl;
-
-    std::cout << "\nFirst 100 bytes of point data:" << std::endl;
-    for (size_t i = 0; i < std::min(size_t(100), pointBuffer.size()); ++i) {
-        std::cout << std::setw(2) << std::setfill('0') << std::hex << (int)(unsigned char)pointBuffer[i] << " ";
-        if ((i + 1) % 34 == 0) std::cout << std::endl;
-    }
-    std::cout << std::dec << std::endl;
+void LAS13Writer::printHeader(std::ostream& out) const {
+    out << "\nLAS File Header Information: " << filename << std::endl;
+    out << "File Signature: " << std::string(header.fileSignature, 4) << std::endl;
+    out << "Version: " << (int)header.versionMajor << "." << (int)header.versionMinor << std::endl;
+    out << "Header Size: " << header.headerSize << std::endl;
+    out << "Point Data Record Format: " << (int)header.pointDataRecordFormat << std::endl;
+    out << "Point Data Record Length: " << header.pointDataRecordLength << std::endl;
+    out << "Number of Point Records: " << header.numberOfPointRecords << std::endl;
+    out << "Scale Factors (X, Y, Z): " << header.xScaleFactor << ", "
+        << header.yScaleFactor << ", " << header.zScaleFactor << std::endl;
+    out << "Offset (X, Y, Z): " << header.xOffset << ", "
+        << header.yOffset << ", " << header.zOffset << std::endl;
+    out << "Min Bounds (X, Y, Z): " << header.minX << ", "
+        << header.minY << ", " << header.minZ << std::endl;
+    out << "Max Bounds (X, Y, Z): " << header.maxX << ", "
+        << header.maxY << ", " << header.maxZ << std::endl;
+    out << "Point Data Size: " << bytesWritten << " bytes" << std::endl;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "../include/las.h"
 #include "../include/texture.h"
+#include "../include/colors.h"
+#include "../include/color_stats.h"
+#include "../include/classification.h"
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
@@ -12,9 +15,53 @@
 #include <chrono>
 #include <cfloat>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <sys/resource.h>
 
 #define VERSION "1.0.0a"
 
+struct ConversionOptions {
+    // Keep fractions for multi-resolution output, finest level first.
+    // Empty means a single full-density LAS file.
+    std::vector<double> lodLevels;
+    ColorPassOptions colorPass;
+    // Texture decoding workers, 0 means one per core
+    unsigned int textureThreads = 0;
+    // Texture cache budget in MB; when set, colors are computed one material
+    // group at a time so textures can be evicted after use. 0 means unbounded.
+    size_t textureCacheMB = 0;
+    // Directory of raw decoded textures reused across runs, empty to disable
+    std::string textureDiskCache;
+    // Texel count from which textures are stored tiled, 0 to never tile
+    size_t textureTilingThreshold = 2048 * 2048;
+    // Decode all textures into one contiguous arena instead of the texture cache
+    bool textureArena = false;
+    // Decode only the part of each texture its faces' UVs reach
+    bool textureRegions = false;
+    // JPEG decode scale denominator (1, 2, 4 or 8), 0 to pick it per texture
+    // from how many points sample it
+    int jpegScale = 0;
+    // One point per distinct (vertex, texcoord) pair, so vertices on UV seams
+    // keep the color of each side
+    bool splitSeams = false;
+    // Write each vertex displaced by its offset along the vertex normal
+    bool surfaceOffset = false;
+    // Vertex normals stored in each point's extra bytes
+    LASNormalFormat normalFormat = LASNormalFormat::None;
+    // Print a histogram summary of the colors written
+    bool colorStats = false;
+    // Fill the intensity field with the luminance of each point's color
+    bool intensity = false;
+    // Rules file mapping material names to classification codes, empty to
+    // leave points unclassified
+    std::string classificationRules;
+    // Print each output file's LAS header after writing it
+    bool verbose = false;
+};
+
 struct GlobalToLocalTransform {
     double global_x_offset = 0.0;
     double global_y_offset = 0.0;
@@ -112,86 +159,6 @@ void applyGlobalToLocalTransform(double& x, double& y, const GlobalToLocalTransf
         // z = z; // Z unchanged
     }
 }
-std::vector<Vec3> computeVertexColorsFromTexture(const tinyobj::attrib_t& attrib,
-                                                 const std::vector<tinyobj::shape_t>& shapes,
-                                                 const std::vector<tinyobj::material_t>& materials,
-                                                 const std::string& objFilename,
-                                                 const std::string& textureFilename) {
-    (void)materials; // Suppress unused parameter warning
-
-    std::vector<Vec3> vertexColors(attrib.vertices.size() / 3);
-
-    if (attrib.texcoords.empty()) {
-        std::cout << "No texture coordinates found in the OBJ file." << std::endl;
-        return vertexColors;  // Return empty colors if no texture coordinates
-    }
-
-    std::string objPath = getParentPath(objFilename);
-    std::string texturePath = textureFilename;
-
-    // If texture path is relative, make it relative to OBJ file location
-    if (texturePath.find(':') == std::string::npos &&
-        (texturePath.empty() || (texturePath[0] != '/' && texturePath[0] != '\\'))) {
-        texturePath = joinPaths(objPath, texturePath);
-    }
-
-    Texture texture = loadTexture(texturePath);
-    if (texture.data.empty()) {
-        std::cerr << "Failed to load texture: " << texturePath << std::endl;
-        return vertexColors;  // Return empty colors if texture loading failed
-    }
-
-    std::vector<Vec3> colorSums(attrib.vertices.size() / 3, Vec3());
-    std::vector<int> colorCounts(attrib.vertices.size() / 3, 0);
-
-    for (const auto& shape : shapes) {
-        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
-            for (unsigned int vert = 0; vert < fv; vert++) {
-                tinyobj::index_t idx = shape.mesh.indices[f * fv + vert];
-                if (idx.texcoord_index < 0) continue;
-
-                float u = attrib.texcoords[2 * idx.texcoord_index + 0];
-                float v = attrib.texcoords[2 * idx.texcoord_index + 1];
-
-                Vec3 color = sampleTexture(texture, u, v);
-                colorSums[idx.vertex_index] = colorSums[idx.vertex_index] + color;
-                colorCounts[idx.vertex_index]++;
-            }
-        }
-    }
-
-    for (size_t i = 0; i < vertexColors.size(); i++) {
-        if (colorCounts[i] > 0) {
-            vertexColors[i] = colorSums[i] * (1.0f / colorCounts[i]);
-            // Apply gamma correction
-            vertexColors[i].x = pow(vertexColors[i].x, 0.4545f);
-            vertexColors[i].y = pow(vertexColors[i].y, 0.4545f);
-            vertexColors[i].z = pow(vertexColors[i].z, 0.4545f);
-        }
-    }
-    std::cout << "Computed " << vertexColors.size() << " vertex colors." << std::endl;
-    // print unique colors
-    std::vector<Vec3> uniqueColors;
-    for (size_t i = 0; i < vertexColors.size(); i++) {
-        bool found = false;
-        for (size_t j = 0; j < uniqueColors.size(); j++) {
-            if (vertexColors[i].x == uniqueColors[j].x &&
-                vertexColors[i].y == uniqueColors[j].y &&
-                vertexColors[i].z == uniqueColors[j].z) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            uniqueColors.push_back(vertexColors[i]);
-        }
-    }
-    std::cout << "Unique colors: " << uniqueColors.size() << std::endl;
-
-    return vertexColors;
-}
-
 // Helper function to get file extension
 std::string getFileExtension(const std::string& filename) {
     size_t dotPos = filename.find_last_of(".");
@@ -206,145 +173,45 @@ std::string getFileNameWithoutExtension(const std::string& filename) {
     else lastSlash++;
     if (lastDot == std::string::npos || lastDot < lastSlash) lastDot = filename.length();
     return filename.substr(lastSlash, lastDot - lastSlash);
-}std::vector<Vec3> computeVertexColorsFromTextures(
-    const tinyobj::attrib_t& attrib,
-    const std::vector<tinyobj::shape_t>& shapes,
-    const std::vector<tinyobj::material_t>& materials,
-    const std::map<std::string, Texture>& textures) {
-
-    std::vector<Vec3> vertexColors(attrib.vertices.size() / 3, Vec3(1, 1, 1));
-    std::vector<Vec3> vertexNormals(attrib.vertices.size() / 3, Vec3(0, 0, 0));
-
-    if (attrib.texcoords.empty()) {
-        std::cout << "No texture coordinates found in the OBJ file." << std::endl;
-        return vertexColors;
-    }
-
-    std::cout << "Number of shapes: " << shapes.size() << std::endl;
-    std::cout << "Number of materials: " << materials.size() << std::endl;
-    std::cout << "Number of textures: " << textures.size() << std::endl;
-
-    int texturedVertices = 0;
-
-    // Helper functions for vector operations
-    auto vec3_subtract = [](const Vec3& a, const Vec3& b) -> Vec3 {
-        return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
-    };
-
-    auto vec3_cross = [](const Vec3& a, const Vec3& b) -> Vec3 {
-        return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
-    };
-
-    auto vec3_normalize = [](Vec3& v) {
-        float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-        if (length > 0) {
-            v.x /= length;
-            v.y /= length;
-            v.z /= length;
-        }
-    };
-
-    // First pass: compute vertex normals
-    for (const auto& shape : shapes) {
-        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
-
-            // Compute face normal
-            Vec3 v0, v1, v2;
-            for (unsigned int v = 0; v < fv; v++) {
-                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
-                float vx = attrib.vertices[3 * idx.vertex_index + 0];
-                float vy = attrib.vertices[3 * idx.vertex_index + 1];
-                float vz = attrib.vertices[3 * idx.vertex_index + 2];
-                if (v == 0) v0 = Vec3(vx, vy, vz);
-                if (v == 1) v1 = Vec3(vx, vy, vz);
-                if (v == 2) v2 = Vec3(vx, vy, vz);
-            }
-            Vec3 faceNormal = vec3_cross(vec3_subtract(v1, v0), vec3_subtract(v2, v0));
-            vec3_normalize(faceNormal);
-
-            // Accumulate face normal to vertex normals
-            for (unsigned int v = 0; v < fv; v++) {
-                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
-                vertexNormals[idx.vertex_index].x += faceNormal.x;
-                vertexNormals[idx.vertex_index].y += faceNormal.y;
-                vertexNormals[idx.vertex_index].z += faceNormal.z;
-            }
-        }
-    }
+}
 
-    // Normalize vertex normals
-    for (auto& normal : vertexNormals) {
-        vec3_normalize(normal);
+// Output name of a LOD level: out.las -> out_lod0.las, out_lod1.las, ...
+std::string getLodFilename(const std::string& lasFilename, size_t level) {
+    std::string extension = getFileExtension(lasFilename);
+    size_t lastSlash = lasFilename.find_last_of("/\\");
+    if (lastSlash != std::string::npos && lastSlash > lasFilename.length() - extension.length()) {
+        extension.clear();
     }
+    std::string base = lasFilename.substr(0, lasFilename.length() - extension.length());
+    return base + "_lod" + std::to_string(level) + (extension.empty() ? ".las" : extension);
+}
 
-    // Second pass: compute colors and store offsets
-    const float offsetMagnitude = 0.0001f; // Adjust this value as needed
-    std::vector<Vec3> vertexOffsets(attrib.vertices.size() / 3, Vec3(0, 0, 0));
+// Stable pseudo-random rank in [0, 1) per vertex. A vertex belongs to every LOD
+// level whose keep fraction is above its rank, so coarser levels are nested
+// subsets of finer ones.
+double lodRank(size_t vertexIndex) {
+    uint64_t z = static_cast<uint64_t>(vertexIndex) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return static_cast<double>(z >> 11) * (1.0 / 9007199254740992.0);
+}
 
+// Marks the materials that at least one face points at
+std::vector<bool> findReferencedMaterials(const std::vector<tinyobj::shape_t>& shapes, size_t materialCount) {
+    std::vector<bool> referenced(materialCount, false);
     for (const auto& shape : shapes) {
-        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
-            int materialId = shape.mesh.material_ids[f];
-
-            if (materialId < 0 || materialId >= static_cast<int>(materials.size())) {
-                std::cout << "Invalid material ID: " << materialId << std::endl;
-                continue;
-            }
-
-            const auto& material = materials[materialId];
-            auto textureIt = textures.find(material.diffuse_texname);
-
-            if (textureIt == textures.end()) {
-                // std::cout << "Texture not found: " << material.diffuse_texname << materialId << textureIt << std::endl;
-                Vec3 materialColor(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
-                for (unsigned int v = 0; v < fv; v++) {
-                    tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
-                    vertexColors[idx.vertex_index] = materialColor;
-                }
-                continue;
-            }
-
-            const auto& texture = textureIt->second;
-
-            for (unsigned int v = 0; v < fv; v++) {
-                tinyobj::index_t idx = shape.mesh.indices[f * fv + v];
-                if (idx.texcoord_index < 0 || idx.vertex_index < 0) {
-                    std::cout << "Invalid index encountered: vertex_index=" << idx.vertex_index
-                              << ", texcoord_index=" << idx.texcoord_index << std::endl;
-                    continue;
-                }
-
-                float u = attrib.texcoords[2 * idx.texcoord_index + 0];
-                float v_cord = attrib.texcoords[2 * idx.texcoord_index + 1];
-
-                // Flip V coordinate
-                v_cord = 1.0f - v_cord;
-
-                Vec3 color = sampleTexture(texture, u, v_cord);
-
-                // Apply gamma correction
-                color.x = std::pow(color.x / 255.0f, 2.2f);
-                color.y = std::pow(color.y / 255.0f, 2.2f);
-                color.z = std::pow(color.z / 255.0f, 2.2f);
-
-                vertexColors[idx.vertex_index] = color;
-                texturedVertices++;
-
-                // Store offset along vertex normal
-                Vec3& normal = vertexNormals[idx.vertex_index];
-                vertexOffsets[idx.vertex_index].x += normal.x * offsetMagnitude;
-                vertexOffsets[idx.vertex_index].y += normal.y * offsetMagnitude;
-                vertexOffsets[idx.vertex_index].z += normal.z * offsetMagnitude;
+        for (int materialId : shape.mesh.material_ids) {
+            if (materialId >= 0 && static_cast<size_t>(materialId) < materialCount) {
+                referenced[materialId] = true;
             }
         }
     }
-
-    std::cout << "Total textured vertices: " << texturedVertices << " out of " << vertexColors.size() << std::endl;
-
-    return vertexColors;
+    return referenced;
 }
-void convertObjToLas(const std::string& objFilename, const std::string& lasFilename) {
+
+void convertObjToLas(const std::string& objFilename, const std::string& lasFilename,
+                     const ConversionOptions& options) {
     try {
         tinyobj::ObjReaderConfig reader_config;
         reader_config.mtl_search_path = getParentPath(objFilename); // Path to material files
@@ -392,62 +259,265 @@ void convertObjToLas(const std::string& objFilename, const std::string& lasFilen
             std::cout << "Need translation and file saved to: " << transformFile << std::endl;
         }
         transform.saveTransformInfo(transformFile);
-        LAS13Writer writer;
-        if (!writer.open(lasFilename)) {
-            throw std::runtime_error("Failed to open LAS file for writing: " + lasFilename);
+
+        // One writer per LOD level, all fed from the same parse and color pass
+        std::vector<double> levels = options.lodLevels;
+        if (levels.empty()) {
+            levels.push_back(1.0);
+        }
+        std::vector<std::string> outputFilenames;
+        for (size_t level = 0; level < levels.size(); level++) {
+            outputFilenames.push_back(options.lodLevels.empty() ? lasFilename : getLodFilename(lasFilename, level));
+        }
+        std::vector<LAS13Writer> writers(levels.size());
+        for (size_t level = 0; level < writers.size(); level++) {
+            if (!writers[level].open(outputFilenames[level], options.normalFormat)) {
+                throw std::runtime_error("Failed to open LAS file for writing: " + outputFilenames[level]);
+            }
         }
 
         // Load all textures
-        std::map<std::string, Texture> textures;
-        for (const auto& material : materials) {
-            if (!material.diffuse_texname.empty()) {
-                std::string texturePath = joinPaths(getParentPath(objFilename), material.diffuse_texname);
-                textures[material.diffuse_texname] = loadTexture(texturePath);
-                std::cout << "Loaded texture: " << material.diffuse_texname << std::endl;
+        // Only decode textures of materials that faces actually use; exports
+        // often ship the MTL of a whole project
+        std::vector<bool> referencedMaterials = findReferencedMaterials(shapes, materials.size());
+        std::vector<std::string> texturePaths;
+        std::vector<std::string> unreferencedPaths;
+        for (size_t m = 0; m < materials.size(); m++) {
+            if (!materials[m].diffuse_texname.empty()) {
+                std::string texturePath = joinPaths(getParentPath(objFilename), materials[m].diffuse_texname);
+                (referencedMaterials[m] ? texturePaths : unreferencedPaths).push_back(texturePath);
             }
         }
+        std::sort(texturePaths.begin(), texturePaths.end());
+        std::sort(unreferencedPaths.begin(), unreferencedPaths.end());
+        unreferencedPaths.erase(std::unique(unreferencedPaths.begin(), unreferencedPaths.end()), unreferencedPaths.end());
+        size_t skippedTextures = 0;
+        size_t skippedBytes = 0;
+        for (const auto& path : unreferencedPaths) {
+            // A file shared with a used material is decoded anyway
+            if (!std::binary_search(texturePaths.begin(), texturePaths.end(), path)) {
+                skippedTextures++;
+                skippedBytes += decodedTextureSize(path);
+            }
+        }
+        if (skippedTextures > 0) {
+            std::cout << "Skipped " << skippedTextures << " textures not referenced by any face ("
+                      << skippedBytes / (1024.0 * 1024.0) << " MB of decoding)" << std::endl;
+        }
 
-        std::cout << "Loaded " << textures.size() << " textures." << std::endl;
+        setTextureDiskCache(options.textureDiskCache);
+        setTextureTilingThreshold(options.textureTilingThreshold);
+        setTextureMipmaps(options.colorPass.filter == TextureFilter::Trilinear || options.colorPass.footprintColors);
+        if (options.textureRegions) {
+            std::map<std::string, TextureUvBounds> uvBounds;
+            for (const auto& entry : computeTextureUvBounds(attrib, shapes, materials)) {
+                uvBounds[joinPaths(getParentPath(objFilename), entry.first)] = entry.second;
+            }
+            setTextureUvBounds(uvBounds);
+        }
+        // Only the automatic JPEG scale reads the sample counts, and only
+        // builds that decode JPEGs scaled can use it
+        if (options.jpegScale == 0 && jpegScaledDecodeAvailable()) {
+            std::map<std::string, size_t> sampleCounts;
+            for (const auto& entry : computeTextureSampleCounts(attrib, shapes, materials)) {
+                sampleCounts[joinPaths(getParentPath(objFilename), entry.first)] = entry.second;
+            }
+            setTextureSampleCounts(sampleCounts);
+        }
+        setTextureDecodeScale(options.jpegScale);
+        std::vector<Vec3> vertexColors;
+        // Vertex each point is written at when seams are split, empty for one
+        // point per vertex
+        std::vector<uint32_t> pointVertices;
+        // Geometry stages the output consumes
+        VertexGeometry geometry;
+        if (options.surfaceOffset) {
+            geometry.requested |= kVertexOffsets;
+        }
+        if (options.normalFormat != LASNormalFormat::None) {
+            geometry.requested |= kVertexNormals;
+        }
+        if (!options.classificationRules.empty()) {
+            std::vector<ClassificationRule> rules = loadClassificationRules(options.classificationRules);
+            geometry.materialClasses = compileClassificationTable(rules, materials);
+            size_t classified = std::count_if(geometry.materialClasses.begin(), geometry.materialClasses.end(),
+                                              [](uint8_t code) { return code != 0; });
+            std::cout << "Loaded " << rules.size() << " classification rules; " << classified << " of "
+                      << materials.size() << " materials classified" << std::endl;
+            geometry.requested |= kVertexClasses;
+        }
+        if (options.textureCacheMB > 0) {
+            // Bounded memory: decode each texture when its material group comes up
+            setTextureCacheBudget(options.textureCacheMB * 1024 * 1024);
+            vertexColors = computeVertexColorsByMaterial(attrib, shapes, materials, [&](size_t materialId) {
+                return loadTexture(joinPaths(getParentPath(objFilename), materials[materialId].diffuse_texname));
+            }, options.colorPass);
+        } else {
+            std::map<std::string, TexturePtr> decoded;
+            if (options.textureArena) {
+                std::shared_ptr<const TextureArena> arena = loadTextureArena(texturePaths, options.textureThreads);
+                if (!arena) {
+                    throw std::runtime_error("Failed to allocate the texture arena");
+                }
+                decoded = arena->textures;
+                std::cout << "Texture arena: " << arena->textures.size() << " textures in "
+                          << arena->size / (1024.0 * 1024.0) << " MB" << std::endl;
+            } else {
+                decoded = loadTexturesParallel(texturePaths, options.textureThreads);
+            }
+
+            std::map<std::string, TexturePtr> textures;
+            for (size_t m = 0; m < materials.size(); m++) {
+                const auto& material = materials[m];
+                if (referencedMaterials[m] && !material.diffuse_texname.empty()) {
+                    auto decodedIt = decoded.find(joinPaths(getParentPath(objFilename), material.diffuse_texname));
+                    if (decodedIt != decoded.end()) {
+                        textures[material.diffuse_texname] = decodedIt->second;
+                    }
+                }
+            }
 
-        // Compute vertex colors using the provided textures
-        std::vector<Vec3> vertexColors = computeVertexColorsFromTextures(attrib, shapes, materials, textures);
+            std::cout << "Loaded " << textures.size() << " textures." << std::endl;
+
+            if (options.splitSeams) {
+                CornerPoints points = computeCornerPointColors(attrib, shapes, materials, textures, options.colorPass);
+                vertexColors.swap(points.colors);
+                pointVertices.swap(points.vertices);
+            } else {
+                // Compute vertex colors using the provided textures
+                vertexColors =
+                    computeVertexColorsFromTextures(attrib, shapes, materials, textures, options.colorPass, &geometry);
+            }
+        }
 
         std::cout << "Computed " << vertexColors.size() << " vertex colors." << std::endl;
+        // Passes that do not produce geometry leave the normals to their own stage
+        if ((geometry.requested & kVertexNormals) && geometry.normals.empty()) {
+            geometry.normals = computeVertexNormals(attrib, shapes, options.colorPass.threads);
+        }
 
-        // Process each vertex
-for (size_t v = 0; v < attrib.vertices.size() / 3; v++) {
-    // std::cout << "Processing vertex " << v + 0 << " of " << attrib.vertices.size() / 3 << std::endl;
-    // std::cout << "Processing vertex " << v + 1 << " of " << attrib.vertices.size() / 3 << std::endl;
-    // std::cout << "Processing vertex " << v + 2 << " of " << attrib.vertices.size() / 3 << std::endl;
-    // // print 
-    double x = attrib.vertices[3 * v + 0];
-    double y = attrib.vertices[3 * v + 1];
-    double z = attrib.vertices[3 * v + 2];
-
-
-    // Apply a threshold to very dark colors
-    float threshold = 0.01f; // Adjust this value as needed
-    float r = std::max(vertexColors[v].x, threshold);
-    float g = std::max(vertexColors[v].y, threshold);
-    float b = std::max(vertexColors[v].z, threshold);
-
-    // Convert to 16-bit color values
-    uint16_t r16 = static_cast<uint16_t>(r * 65535);
-    uint16_t g16 = static_cast<uint16_t>(g * 65535);
-    uint16_t b16 = static_cast<uint16_t>(b * 65535);
-    // print x,y,z
-    // std::cout << "x: " << x << " y: " << y << " z: " << z << std::endl;  
-
-
-    applyGlobalToLocalTransform(x, y, transform);
-    // std::cout << "x: " << x << " y: " << y << " z: " << z << std::endl;  
-    // return;
-    writer.addPointColor(x, y, z, r16, g16, b16);
-}
-        writer.close();
+        // Same transfer settings as the color pass
+        const ColorTransfer transfer(options.colorPass.transfer);
+        if (options.colorStats) {
+            printColorStatistics(computeColorStatistics(vertexColors, transfer, options.colorPass.threads), std::cout);
+        }
+
+        // Points are written in blocks: one pass gathers the positions and
+        // linear colors of a block, the color kernel turns the colors into
+        // 16-bit RGB and intensity, then every level takes the points whose
+        // rank is below its fraction through the writers' batch API
+        const size_t kWriteBlock = 4096;
+        std::vector<double> pointX(kWriteBlock), pointY(kWriteBlock), pointZ(kWriteBlock), ranks(kWriteBlock);
+        std::vector<float> linearRed(kWriteBlock), linearGreen(kWriteBlock), linearBlue(kWriteBlock);
+        std::vector<uint16_t> red(kWriteBlock), green(kWriteBlock), blue(kWriteBlock);
+        std::vector<uint16_t> intensity(options.intensity ? kWriteBlock : 0);
+        std::vector<uint8_t> classification(geometry.classes.empty() ? 0 : kWriteBlock);
+        std::vector<float> normalX, normalY, normalZ;
+        // Ranks are only needed when some level keeps less than everything;
+        // levels are sorted finest first, so the last one is the coarsest
+        const bool ranked = levels.back() < 1.0;
+        if (!geometry.normals.empty()) {
+            normalX.resize(kWriteBlock);
+            normalY.resize(kWriteBlock);
+            normalZ.resize(kWriteBlock);
+        }
+        for (size_t begin = 0; begin < vertexColors.size(); begin += kWriteBlock) {
+            size_t count = std::min(kWriteBlock, vertexColors.size() - begin);
+            for (size_t i = 0; i < count; i++) {
+                size_t v = begin + i;
+                size_t vertex = pointVertices.empty() ? v : pointVertices[v];
+                double x = attrib.vertices[3 * vertex + 0];
+                double y = attrib.vertices[3 * vertex + 1];
+                double z = attrib.vertices[3 * vertex + 2];
+                if (!geometry.offsets.empty()) {
+                    x += geometry.offsets[vertex].x;
+                    y += geometry.offsets[vertex].y;
+                    z += geometry.offsets[vertex].z;
+                }
+                applyGlobalToLocalTransform(x, y, transform);
+                pointX[i] = x;
+                pointY[i] = y;
+                pointZ[i] = z;
+
+                linearRed[i] = vertexColors[v].x;
+                linearGreen[i] = vertexColors[v].y;
+                linearBlue[i] = vertexColors[v].z;
+                if (!classification.empty()) {
+                    classification[i] = geometry.classes[vertex];
+                }
+                if (!normalX.empty()) {
+                    normalX[i] = geometry.normals[vertex].x;
+                    normalY[i] = geometry.normals[vertex].y;
+                    normalZ[i] = geometry.normals[vertex].z;
+                }
+                ranks[i] = ranked ? lodRank(v) : 0.0;
+            }
+            // Apply a threshold to very dark colors and convert to 16-bit color values
+            transfer.encodeBlock(linearRed.data(), linearGreen.data(), linearBlue.data(), count, red.data(),
+                                 green.data(), blue.data(), intensity.empty() ? nullptr : intensity.data());
+
+            LASPointBatch batch;
+            batch.x = pointX.data();
+            batch.y = pointY.data();
+            batch.z = pointZ.data();
+            batch.red = red.data();
+            batch.green = green.data();
+            batch.blue = blue.data();
+            batch.intensity = intensity.empty() ? nullptr : intensity.data();
+            batch.classification = classification.empty() ? nullptr : classification.data();
+            if (!normalX.empty()) {
+                batch.normalX = normalX.data();
+                batch.normalY = normalY.data();
+                batch.normalZ = normalZ.data();
+            }
+            // Levels are sorted finest first, so each level's points are a
+            // subset of the previous level's and the block shrinks in place
+            for (size_t level = 0; level < writers.size() && count > 0; level++) {
+                if (ranked) {
+                    size_t kept = 0;
+                    for (size_t i = 0; i < count; i++) {
+                        if (ranks[i] < levels[level]) {
+                            pointX[kept] = pointX[i];
+                            pointY[kept] = pointY[i];
+                            pointZ[kept] = pointZ[i];
+                            red[kept] = red[i];
+                            green[kept] = green[i];
+                            blue[kept] = blue[i];
+                            if (!intensity.empty()) {
+                                intensity[kept] = intensity[i];
+                            }
+                            if (!classification.empty()) {
+                                classification[kept] = classification[i];
+                            }
+                            if (!normalX.empty()) {
+                                normalX[kept] = normalX[i];
+                                normalY[kept] = normalY[i];
+                                normalZ[kept] = normalZ[i];
+                            }
+                            ranks[kept] = ranks[i];
+                            kept++;
+                        }
+                    }
+                    count = kept;
+                }
+                batch.count = count;
+                writers[level].addPoints(batch);
+            }
+        }
+        for (auto& writer : writers) {
+            writer.close();
+            if (options.verbose) {
+                writer.printHeader(std::cout);
+            }
+        }
 
-        std::cout << "Conversion complete. LAS file saved as: " << lasFilename << std::endl;
+        for (const auto& outputFilename : outputFilenames) {
+            std::cout << "Conversion complete. LAS file saved as: " << outputFilename << std::endl;
+        }
         std::cout << "Total vertices processed: " << attrib.vertices.size() / 3 << std::endl;
+        TextureCacheStats cacheStats = textureCacheStats();
+        std::cout << "Texture cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses, "
+                  << cacheStats.evictions << " evictions, " << cacheStats.diskHits << " disk cache hits, peak " << cacheStats.peakBytes / (1024.0 * 1024.0) << " MB" << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Error during conversion: " << e.what() << std::endl;
         std::cerr << "OBJ file: " << objFilename << std::endl;
@@ -460,17 +530,171 @@ int main(int argc, char* argv[]) {
     // start timer and clock memory usage
     auto start_full = std::chrono::high_resolution_clock::now();
 
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input.obj> <output.las>" << std::endl;
+    ConversionOptions options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--lod" && i + 1 < argc) {
+            // Comma separated keep fractions, e.g. --lod 1,0.25,0.0625
+            std::stringstream levels(argv[++i]);
+            std::string level;
+            while (std::getline(levels, level, ',')) {
+                double fraction = std::atof(level.c_str());
+                if (fraction <= 0.0 || fraction > 1.0) {
+                    std::cerr << "Invalid LOD fraction: " << level << " (expected 0 < f <= 1)" << std::endl;
+                    return 1;
+                }
+                options.lodLevels.push_back(fraction);
+            }
+            std::sort(options.lodLevels.begin(), options.lodLevels.end(), std::greater<double>());
+        } else if (arg == "--texture-threads" && i + 1 < argc) {
+            options.textureThreads = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (arg == "--texture-cache-mb" && i + 1 < argc) {
+            options.textureCacheMB = static_cast<size_t>(std::atol(argv[++i]));
+        } else if (arg == "--texture-disk-cache" && i + 1 < argc) {
+            options.textureDiskCache = argv[++i];
+        } else if (arg == "--color-threads" && i + 1 < argc) {
+            options.colorPass.threads = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (arg == "--texture-arena") {
+            options.textureArena = true;
+        } else if (arg == "--texture-roi") {
+            options.textureRegions = true;
+        } else if (arg == "--jpeg-scale" && i + 1 < argc) {
+            std::string scale = argv[++i];
+            if (scale == "auto") {
+                options.jpegScale = 0;
+            } else if (scale == "1" || scale == "2" || scale == "4" || scale == "8") {
+                options.jpegScale = std::atoi(scale.c_str());
+            } else {
+                std::cerr << "Invalid JPEG scale: " << scale << " (expected auto, 1, 2, 4 or 8)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--texture-tiling" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "on") {
+                options.textureTilingThreshold = 1;
+            } else if (mode == "off") {
+                options.textureTilingThreshold = 0;
+            } else if (mode != "auto") {
+                std::cerr << "Invalid texture tiling mode: " << mode << " (expected auto, on or off)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--texture-filter" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (filter == "nearest") {
+                options.colorPass.filter = TextureFilter::Nearest;
+            } else if (filter == "bilinear") {
+                options.colorPass.filter = TextureFilter::Bilinear;
+            } else if (filter == "trilinear") {
+                options.colorPass.filter = TextureFilter::Trilinear;
+            } else {
+                std::cerr << "Invalid texture filter: " << filter << " (expected nearest, bilinear or trilinear)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--normals" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "float") {
+                options.normalFormat = LASNormalFormat::Float32;
+            } else if (format == "int16") {
+                options.normalFormat = LASNormalFormat::Int16;
+            } else {
+                std::cerr << "Invalid normal format: " << format << " (expected float or int16)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--color-gamma" && i + 1 < argc) {
+            options.colorPass.transfer.gamma = static_cast<float>(std::atof(argv[++i]));
+            if (!(options.colorPass.transfer.gamma > 0.0f)) {
+                std::cerr << "Invalid color gamma: " << argv[i] << " (expected a positive number)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--color-floor" && i + 1 < argc) {
+            options.colorPass.transfer.darkFloor = static_cast<float>(std::atof(argv[++i]));
+            if (options.colorPass.transfer.darkFloor < 0.0f || options.colorPass.transfer.darkFloor > 1.0f) {
+                std::cerr << "Invalid color floor: " << argv[i] << " (expected 0 <= f <= 1)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--average-colors") {
+            options.colorPass.averageColors = true;
+        } else if (arg == "--split-seams") {
+            options.splitSeams = true;
+        } else if (arg == "--color-stats") {
+            options.colorStats = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else if (arg == "--intensity") {
+            options.intensity = true;
+        } else if (arg == "--class-rules" && i + 1 < argc) {
+            options.classificationRules = argv[++i];
+        } else if (arg == "--surface-offset") {
+            options.surfaceOffset = true;
+        } else if (arg == "--footprint-colors") {
+            options.colorPass.footprintColors = true;
+        } else if (arg == "--sorted-color-pass") {
+            options.colorPass.sortedSampling = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 2) {
+        std::cerr << "Usage: " << argv[0] << " [options] <input.obj> <output.las>" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --lod f0,f1,...        write one LAS per keep fraction (nested subsets)" << std::endl;
+        std::cerr << "  --sorted-color-pass    sample textures in (texture, tile) order" << std::endl;
+        std::cerr << "  --texture-threads n    texture decoding workers (default: one per core)" << std::endl;
+        std::cerr << "  --color-threads n      color and normal pass workers (default: one per core)" << std::endl;
+        std::cerr << "  --texture-cache-mb n   bound decoded textures to n MB, evicting LRU" << std::endl;
+        std::cerr << "  --texture-disk-cache d reuse raw decoded textures stored in directory d" << std::endl;
+        std::cerr << "  --texture-tiling m     store textures in 32x32 tiles: auto, on or off" << std::endl;
+        std::cerr << "  --texture-arena        decode all textures into one contiguous allocation" << std::endl;
+        std::cerr << "  --texture-roi          decode only the texture regions faces reference" << std::endl;
+        std::cerr << "  --jpeg-scale s         decode JPEGs at 1/s size: auto, 1, 2, 4 or 8" << std::endl;
+        std::cerr << "  --texture-filter f     texture filter: nearest, bilinear or trilinear" << std::endl;
+        std::cerr << "  --footprint-colors     average texels over each vertex's UV footprint" << std::endl;
+        std::cerr << "  --average-colors       average the colors of all faces around a vertex" << std::endl;
+        std::cerr << "  --split-seams          write one point per vertex and texcoord pair" << std::endl;
+        std::cerr << "  --surface-offset       move textured vertices off the surface along their normal" << std::endl;
+        std::cerr << "  --normals f            store vertex normals as extra bytes: float or int16" << std::endl;
+        std::cerr << "                         (a LAS 1.4 VLR in a file whose header says 1.3)" << std::endl;
+        std::cerr << "  --color-stats          print unique colors, top colors and channel percentiles" << std::endl;
+        std::cerr << "  --intensity            write the Rec. 709 luminance of each color as intensity" << std::endl;
+        std::cerr << "  --class-rules f        classify points by material name, one \"pattern code\" per line" << std::endl;
+        std::cerr << "  --color-gamma g        gamma of the texel to linear color conversion (default 2.2)" << std::endl;
+        std::cerr << "  --color-floor f        raise linear colors below f to f (default 0.01)" << std::endl;
+        std::cerr << "  --verbose              print the header of every LAS file written" << std::endl;
+        return 1;
+    }
+    if (options.textureArena && options.textureCacheMB > 0) {
+        std::cerr << "--texture-arena cannot be combined with --texture-cache-mb" << std::endl;
+        return 1;
+    }
+    if (options.splitSeams && options.textureCacheMB > 0) {
+        std::cerr << "--split-seams cannot be combined with --texture-cache-mb" << std::endl;
+        return 1;
+    }
+    if (options.surfaceOffset && (options.splitSeams || options.textureCacheMB > 0)) {
+        std::cerr << "--surface-offset cannot be combined with --split-seams or --texture-cache-mb" << std::endl;
+        return 1;
+    }
+    if (!options.classificationRules.empty() && (options.splitSeams || options.textureCacheMB > 0)) {
+        std::cerr << "--class-rules cannot be combined with --split-seams or --texture-cache-mb" << std::endl;
         return 1;
     }
 
-    std::string objFilename = argv[1];
-    std::string lasFilename = argv[2];
+    std::string objFilename = positional[0];
+    std::string lasFilename = positional[1];
 
-    convertObjToLas(objFilename, lasFilename);
+    convertObjToLas(objFilename, lasFilename, options);
     // print timer
     std::cout << "Total time taken: " << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start_full).count() << "s" << std::endl;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        // ru_maxrss is reported in kilobytes on Linux
+        std::cout << "Peak memory usage: " << usage.ru_maxrss / 1024 << " MB" << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
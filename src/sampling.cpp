@@ -0,0 +1,572 @@
+#include "include/sampling.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBJ2LAS_HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+TriangleMesh buildTriangleMesh(const tinyobj::attrib_t& attrib,
+                               const std::vector<tinyobj::shape_t>& shapes) {
+    TriangleMesh mesh;
+    mesh.origin[0] = mesh.origin[1] = mesh.origin[2] = DBL_MAX;
+    for (size_t i = 0; i < attrib.vertices.size(); i++) {
+        mesh.origin[i % 3] = std::min(mesh.origin[i % 3], static_cast<double>(attrib.vertices[i]));
+    }
+    if (attrib.vertices.empty()) {
+        mesh.origin[0] = mesh.origin[1] = mesh.origin[2] = 0.0;
+    }
+
+    size_t triangleCount = 0;
+    for (const auto& shape : shapes) {
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            if (shape.mesh.num_face_vertices[f] >= 3) {
+                triangleCount += shape.mesh.num_face_vertices[f] - 2;
+            }
+        }
+    }
+    mesh.x.reserve(3 * triangleCount);
+    mesh.y.reserve(3 * triangleCount);
+    mesh.z.reserve(3 * triangleCount);
+    mesh.u.reserve(3 * triangleCount);
+    mesh.v.reserve(3 * triangleCount);
+    mesh.materialIds.reserve(triangleCount);
+
+    auto addCorner = [&](const tinyobj::index_t& idx) {
+        mesh.x.push_back(static_cast<float>(attrib.vertices[3 * idx.vertex_index + 0] - mesh.origin[0]));
+        mesh.y.push_back(static_cast<float>(attrib.vertices[3 * idx.vertex_index + 1] - mesh.origin[1]));
+        mesh.z.push_back(static_cast<float>(attrib.vertices[3 * idx.vertex_index + 2] - mesh.origin[2]));
+        if (idx.texcoord_index >= 0) {
+            mesh.u.push_back(static_cast<float>(attrib.texcoords[2 * idx.texcoord_index + 0]));
+            mesh.v.push_back(static_cast<float>(attrib.texcoords[2 * idx.texcoord_index + 1]));
+        } else {
+            mesh.u.push_back(0.0f);
+            mesh.v.push_back(0.0f);
+        }
+    };
+
+    for (const auto& shape : shapes) {
+        size_t indexOffset = 0;
+        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+            unsigned int fv = static_cast<unsigned int>(shape.mesh.num_face_vertices[f]);
+            int materialId = f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
+            for (unsigned int k = 1; k + 1 < fv; k++) {
+                addCorner(shape.mesh.indices[indexOffset]);
+                addCorner(shape.mesh.indices[indexOffset + k]);
+                addCorner(shape.mesh.indices[indexOffset + k + 1]);
+                mesh.materialIds.push_back(materialId);
+            }
+            indexOffset += fv;
+        }
+    }
+    return mesh;
+}
+
+static const Texture* textureFor(const std::vector<const Texture*>& textures, int32_t materialId) {
+    if (materialId < 0 || materialId >= static_cast<int32_t>(textures.size())) {
+        return nullptr;
+    }
+    const Texture* texture = textures[materialId];
+    return (texture && !texture->data.empty()) ? texture : nullptr;
+}
+
+// Nearest texel fetch matching sampleTexture, for textures stored as 3 bytes per texel
+static inline void fetchTexel(const Texture* texture, float tu, float tv, float& r, float& g, float& b) {
+    if (!texture) {
+        r = g = b = 0.0f;
+        return;
+    }
+    float su = tu - std::floor(tu);
+    float flipped = 1.0f - tv;
+    float sv = flipped - std::floor(flipped);
+    int x = texture->storedX(static_cast<int>(su * static_cast<float>(texture->uvWidth() - 1)));
+    int y = texture->storedY(static_cast<int>(sv * static_cast<float>(texture->uvHeight() - 1)));
+    size_t index = texture->texelOffset(x, y);
+    r = static_cast<float>(texture->data[index + 0]);
+    g = static_cast<float>(texture->data[index + 1]);
+    b = static_cast<float>(texture->data[index + 2]);
+    if (r < 200 && g < 200 && b < 200) {
+        r *= 1.15f;
+        g *= 1.15f;
+        b *= 1.15f;
+    }
+}
+
+static inline void interpolateSample(const TriangleMesh& mesh,
+                                     const std::vector<const Texture*>& textures,
+                                     int32_t triangle, float bu, float bv,
+                                     const SampleOutputs& out, size_t i) {
+    size_t c = 3 * static_cast<size_t>(triangle);
+    float w0 = 1.0f - bu - bv;
+    out.x[i] = w0 * mesh.x[c] + bu * mesh.x[c + 1] + bv * mesh.x[c + 2];
+    out.y[i] = w0 * mesh.y[c] + bu * mesh.y[c + 1] + bv * mesh.y[c + 2];
+    out.z[i] = w0 * mesh.z[c] + bu * mesh.z[c + 1] + bv * mesh.z[c + 2];
+    out.u[i] = w0 * mesh.u[c] + bu * mesh.u[c + 1] + bv * mesh.u[c + 2];
+    out.v[i] = w0 * mesh.v[c] + bu * mesh.v[c + 1] + bv * mesh.v[c + 2];
+    fetchTexel(textureFor(textures, mesh.materialIds[triangle]), out.u[i], out.v[i], out.r[i], out.g[i], out.b[i]);
+}
+
+void interpolateSamplesScalar(const TriangleMesh& mesh,
+                              const std::vector<const Texture*>& textures,
+                              const int32_t* triangles, const float* baryU, const float* baryV,
+                              size_t n, const SampleOutputs& out) {
+    for (size_t i = 0; i < n; i++) {
+        interpolateSample(mesh, textures, triangles[i], baryU[i], baryV[i], out, i);
+    }
+}
+
+// Scalar normalization the batch kernels reproduce lane by lane
+static inline void normalize3(Vec3& v) {
+    float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (length > 0) {
+        v.x /= length;
+        v.y /= length;
+        v.z /= length;
+    }
+}
+
+static inline Vec3 faceNormal(const FaceCornerBatch& corners, size_t i) {
+    float ax = corners.x[1][i] - corners.x[0][i], ay = corners.y[1][i] - corners.y[0][i];
+    float az = corners.z[1][i] - corners.z[0][i];
+    float bx = corners.x[2][i] - corners.x[0][i], by = corners.y[2][i] - corners.y[0][i];
+    float bz = corners.z[2][i] - corners.z[0][i];
+    Vec3 normal(ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx);
+    normalize3(normal);
+    return normal;
+}
+
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+
+// Evaluates w0 * a[base] + bu * a[base + 1] + bv * a[base + 2] for 8 lanes,
+// in the same operation order as the scalar path so results match exactly.
+__attribute__((target("avx2")))
+static inline __m256 interpolate8(const float* a, __m256i base, __m256 w0, __m256 bu, __m256 bv) {
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i base1 = _mm256_add_epi32(base, one);
+    __m256i base2 = _mm256_add_epi32(base1, one);
+    __m256 a0 = _mm256_i32gather_ps(a, base, 4);
+    __m256 a1 = _mm256_i32gather_ps(a, base1, 4);
+    __m256 a2 = _mm256_i32gather_ps(a, base2, 4);
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w0, a0), _mm256_mul_ps(bu, a1)), _mm256_mul_ps(bv, a2));
+}
+
+// Byte offsets of texels (x, y) in texture->data for 8 lanes
+__attribute__((target("avx2")))
+static inline __m256i texelOffsets8(const Texture* texture, __m256i x, __m256i y) {
+    __m256i texel;
+    if (texture->layout == TextureLayout::RowMajor) {
+        texel = _mm256_add_epi32(_mm256_mullo_epi32(y, _mm256_set1_epi32(texture->width)), x);
+    } else {
+        const __m256i mask = _mm256_set1_epi32(kTextureTileSize - 1);
+        __m256i tile = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, kTextureTileShift),
+                                                           _mm256_set1_epi32(texture->tilesX())),
+                                        _mm256_srli_epi32(x, kTextureTileShift));
+        texel = _mm256_add_epi32(_mm256_slli_epi32(tile, 2 * kTextureTileShift),
+                                 _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(y, mask), kTextureTileShift),
+                                                  _mm256_and_si256(x, mask)));
+    }
+    return _mm256_add_epi32(_mm256_add_epi32(texel, texel), texel);
+}
+
+// Each lane loads 4 bytes, so the final texel of the image cannot be gathered
+__attribute__((target("avx2")))
+static inline bool gatherable8(const Texture* texture, __m256i offset) {
+    __m256i lastSafe = _mm256_set1_epi32(static_cast<int>(texture->data.size()) - 4);
+    return _mm256_movemask_epi8(_mm256_cmpgt_epi32(offset, lastSafe)) == 0;
+}
+
+__attribute__((target("avx2")))
+static inline void gatherTexels8(const Texture* texture, __m256i offset, __m256& r, __m256& g, __m256& b) {
+    __m256i rgb = _mm256_i32gather_epi32(reinterpret_cast<const int*>(texture->data.data()), offset, 1);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    r = _mm256_cvtepi32_ps(_mm256_and_si256(rgb, byteMask));
+    g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 8), byteMask));
+    b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 16), byteMask));
+}
+
+// The 15% boost sampleTexture applies to colors that are not close to white
+__attribute__((target("avx2")))
+static inline void brightenDark8(__m256& r, __m256& g, __m256& b) {
+    const __m256 limit = _mm256_set1_ps(200.0f);
+    __m256 dark = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(r, limit, _CMP_LT_OQ),
+                                              _mm256_cmp_ps(g, limit, _CMP_LT_OQ)),
+                                _mm256_cmp_ps(b, limit, _CMP_LT_OQ));
+    __m256 factor = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_set1_ps(1.15f), dark);
+    r = _mm256_mul_ps(r, factor);
+    g = _mm256_mul_ps(g, factor);
+    b = _mm256_mul_ps(b, factor);
+}
+
+// Stored column (or row) of image columns i, where origin and size describe
+// the stored part of the axis
+__attribute__((target("avx2")))
+static inline __m256i storedIndex8(__m256i i, int origin, int size) {
+    i = _mm256_sub_epi32(i, _mm256_set1_epi32(origin));
+    return _mm256_max_epi32(_mm256_setzero_si256(), _mm256_min_epi32(i, _mm256_set1_epi32(size - 1)));
+}
+
+// Stored texel column (or row) for wrapped coordinates s in [0, 1) on an
+// axis of imageSize texels
+__attribute__((target("avx2")))
+static inline __m256i texelIndex8(__m256 s, int imageSize, int origin, int size) {
+    __m256i i = _mm256_cvttps_epi32(_mm256_mul_ps(s, _mm256_set1_ps(static_cast<float>(imageSize - 1))));
+    return storedIndex8(i, origin, size);
+}
+
+// Gathers 8 texels from one texture. Returns false when a lane would read past
+// the end of the pixel buffer and the caller has to fall back to scalar fetches.
+__attribute__((target("avx2")))
+static inline bool fetchTexels8(const Texture* texture, __m256 tu, __m256 tv, __m256& r, __m256& g, __m256& b) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 su = _mm256_sub_ps(tu, _mm256_floor_ps(tu));
+    __m256 flipped = _mm256_sub_ps(one, tv);
+    __m256 sv = _mm256_sub_ps(flipped, _mm256_floor_ps(flipped));
+    __m256i offset = texelOffsets8(texture, texelIndex8(su, texture->uvWidth(), texture->originX, texture->width),
+                                   texelIndex8(sv, texture->uvHeight(), texture->originY, texture->height));
+    if (!gatherable8(texture, offset)) {
+        return false;
+    }
+    gatherTexels8(texture, offset, r, g, b);
+    brightenDark8(r, g, b);
+    return true;
+}
+
+// Bilinear blend of 8 lanes of wrapped coordinates on one mip level, in the
+// same operation order as sampleTextureFiltered. Returns false when a lane
+// cannot be gathered.
+__attribute__((target("avx2")))
+static inline bool bilinearTexels8(const Texture* level, __m256 su, __m256 sv, __m256& r, __m256& g, __m256& b) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const int uvWidth = level->uvWidth(), uvHeight = level->uvHeight();
+    __m256 fx = _mm256_mul_ps(su, _mm256_set1_ps(static_cast<float>(uvWidth - 1)));
+    __m256 fy = _mm256_mul_ps(sv, _mm256_set1_ps(static_cast<float>(uvHeight - 1)));
+    __m256i x0 = _mm256_max_epi32(_mm256_setzero_si256(),
+                                  _mm256_min_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(uvWidth - 1)));
+    __m256i y0 = _mm256_max_epi32(_mm256_setzero_si256(),
+                                  _mm256_min_epi32(_mm256_cvttps_epi32(fy), _mm256_set1_epi32(uvHeight - 1)));
+    __m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), _mm256_set1_epi32(uvWidth - 1));
+    __m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), _mm256_set1_epi32(uvHeight - 1));
+    __m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(x0));
+    __m256 ty = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(y0));
+    x0 = storedIndex8(x0, level->originX, level->width);
+    x1 = storedIndex8(x1, level->originX, level->width);
+    y0 = storedIndex8(y0, level->originY, level->height);
+    y1 = storedIndex8(y1, level->originY, level->height);
+
+    __m256i o00 = texelOffsets8(level, x0, y0);
+    __m256i o10 = texelOffsets8(level, x1, y0);
+    __m256i o01 = texelOffsets8(level, x0, y1);
+    __m256i o11 = texelOffsets8(level, x1, y1);
+    // Offsets grow with x and y in both layouts, so the bottom-right texel bounds the others
+    if (!gatherable8(level, o11)) {
+        return false;
+    }
+    __m256 c00[3], c10[3], c01[3], c11[3];
+    gatherTexels8(level, o00, c00[0], c00[1], c00[2]);
+    gatherTexels8(level, o10, c10[0], c10[1], c10[2]);
+    gatherTexels8(level, o01, c01[0], c01[1], c01[2]);
+    gatherTexels8(level, o11, c11[0], c11[1], c11[2]);
+    __m256 channel[3];
+    for (int c = 0; c < 3; c++) {
+        __m256 top = _mm256_add_ps(c00[c], _mm256_mul_ps(_mm256_sub_ps(c10[c], c00[c]), tx));
+        __m256 bottom = _mm256_add_ps(c01[c], _mm256_mul_ps(_mm256_sub_ps(c11[c], c01[c]), tx));
+        channel[c] = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), ty));
+    }
+    r = channel[0];
+    g = channel[1];
+    b = channel[2];
+    return true;
+}
+
+__attribute__((target("avx2")))
+static void sampleTextureBatchAVX2(const Texture& texture, const float* u, const float* v, size_t n, Vec3* out,
+                                   TextureFilter filter, float lod) {
+    // Resolve the mip levels once for the whole batch
+    int maxLevel = texture.levelCount() - 1;
+    bool blendLevels = filter == TextureFilter::Trilinear && lod > 0.0f && maxLevel > 0;
+    const Texture* fine = &texture;
+    const Texture* coarse = nullptr;
+    float blend = 0.0f;
+    if (blendLevels) {
+        lod = std::min(lod, static_cast<float>(maxLevel));
+        int level = static_cast<int>(lod);
+        blend = lod - static_cast<float>(level);
+        fine = &texture.level(level);
+        coarse = level < maxLevel ? &texture.level(level + 1) : nullptr;
+    }
+
+    alignas(32) float r[8], g[8], b[8];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 tu = _mm256_loadu_ps(u + i);
+        __m256 tv = _mm256_loadu_ps(v + i);
+        __m256 su = _mm256_sub_ps(tu, _mm256_floor_ps(tu));
+        __m256 sv = _mm256_sub_ps(tv, _mm256_floor_ps(tv));
+        __m256 vr, vg, vb;
+        bool gathered;
+        if (filter == TextureFilter::Nearest) {
+            __m256i offset = texelOffsets8(&texture, texelIndex8(su, texture.uvWidth(), texture.originX, texture.width),
+                                           texelIndex8(sv, texture.uvHeight(), texture.originY, texture.height));
+            gathered = gatherable8(&texture, offset);
+            if (gathered) {
+                gatherTexels8(&texture, offset, vr, vg, vb);
+            }
+        } else {
+            gathered = bilinearTexels8(fine, su, sv, vr, vg, vb);
+            __m256 cr, cg, cb;
+            if (gathered && coarse) {
+                gathered = bilinearTexels8(coarse, su, sv, cr, cg, cb);
+                __m256 t = _mm256_set1_ps(blend);
+                vr = _mm256_add_ps(vr, _mm256_mul_ps(_mm256_sub_ps(cr, vr), t));
+                vg = _mm256_add_ps(vg, _mm256_mul_ps(_mm256_sub_ps(cg, vg), t));
+                vb = _mm256_add_ps(vb, _mm256_mul_ps(_mm256_sub_ps(cb, vb), t));
+            }
+        }
+        if (!gathered) {
+            for (size_t lane = i; lane < i + 8; lane++) {
+                out[lane] = sampleTextureFiltered(texture, u[lane], v[lane], filter, lod);
+            }
+            continue;
+        }
+        brightenDark8(vr, vg, vb);
+        _mm256_store_ps(r, vr);
+        _mm256_store_ps(g, vg);
+        _mm256_store_ps(b, vb);
+        for (int lane = 0; lane < 8; lane++) {
+            out[i + lane] = Vec3(r[lane], g[lane], b[lane]);
+        }
+    }
+    for (; i < n; i++) {
+        out[i] = sampleTextureFiltered(texture, u[i], v[i], filter, lod);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sampleTexelBatchAVX2(const Texture& texture, const float* u, const float* v, size_t n, uint32_t* out) {
+    const __m256i rgbMask = _mm256_set1_epi32(0xFFFFFF);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 tu = _mm256_loadu_ps(u + i);
+        __m256 tv = _mm256_loadu_ps(v + i);
+        __m256 su = _mm256_sub_ps(tu, _mm256_floor_ps(tu));
+        __m256 sv = _mm256_sub_ps(tv, _mm256_floor_ps(tv));
+        __m256i offset = texelOffsets8(&texture, texelIndex8(su, texture.uvWidth(), texture.originX, texture.width),
+                                       texelIndex8(sv, texture.uvHeight(), texture.originY, texture.height));
+        if (!gatherable8(&texture, offset)) {
+            for (size_t lane = i; lane < i + 8; lane++) {
+                out[lane] = nearestTexel(texture, u[lane], v[lane]);
+            }
+            continue;
+        }
+        __m256i rgb = _mm256_i32gather_epi32(reinterpret_cast<const int*>(texture.data.data()), offset, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(rgb, rgbMask));
+    }
+    for (; i < n; i++) {
+        out[i] = nearestTexel(texture, u[i], v[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void interpolateSamplesAVX2(const TriangleMesh& mesh,
+                                   const std::vector<const Texture*>& textures,
+                                   const int32_t* triangles, const float* baryU, const float* baryV,
+                                   size_t n, const SampleOutputs& out) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i triangle = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(triangles + i));
+        __m256i base = _mm256_add_epi32(_mm256_add_epi32(triangle, triangle), triangle);
+        __m256 bu = _mm256_loadu_ps(baryU + i);
+        __m256 bv = _mm256_loadu_ps(baryV + i);
+        __m256 w0 = _mm256_sub_ps(_mm256_sub_ps(one, bu), bv);
+
+        _mm256_storeu_ps(out.x + i, interpolate8(mesh.x.data(), base, w0, bu, bv));
+        _mm256_storeu_ps(out.y + i, interpolate8(mesh.y.data(), base, w0, bu, bv));
+        _mm256_storeu_ps(out.z + i, interpolate8(mesh.z.data(), base, w0, bu, bv));
+        __m256 tu = interpolate8(mesh.u.data(), base, w0, bu, bv);
+        __m256 tv = interpolate8(mesh.v.data(), base, w0, bu, bv);
+        _mm256_storeu_ps(out.u + i, tu);
+        _mm256_storeu_ps(out.v + i, tv);
+
+        // Vector texel fetch when the whole block samples one texture, which is
+        // the common case once samples are generated per triangle or material
+        alignas(32) int32_t materialIds[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(materialIds),
+                           _mm256_i32gather_epi32(mesh.materialIds.data(), triangle, 4));
+        bool uniform = true;
+        for (int lane = 1; lane < 8; lane++) {
+            uniform = uniform && materialIds[lane] == materialIds[0];
+        }
+        const Texture* texture = textureFor(textures, materialIds[0]);
+        bool fitsInt32 = texture && texture->data.size() < static_cast<size_t>(INT_MAX);
+        __m256 r, g, b;
+        if (uniform && fitsInt32 && fetchTexels8(texture, tu, tv, r, g, b)) {
+            _mm256_storeu_ps(out.r + i, r);
+            _mm256_storeu_ps(out.g + i, g);
+            _mm256_storeu_ps(out.b + i, b);
+            continue;
+        }
+        for (size_t lane = i; lane < i + 8; lane++) {
+            fetchTexel(textureFor(textures, materialIds[lane - i]), out.u[lane], out.v[lane],
+                       out.r[lane], out.g[lane], out.b[lane]);
+        }
+    }
+    for (; i < n; i++) {
+        interpolateSample(mesh, textures, triangles[i], baryU[i], baryV[i], out, i);
+    }
+}
+
+// Normalizes 8 vectors; lanes of length 0 keep their (zero) components
+__attribute__((target("avx2")))
+static inline void normalize8(__m256& x, __m256& y, __m256& z) {
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+                                                 _mm256_mul_ps(z, z)));
+    __m256 nonzero = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+    x = _mm256_blendv_ps(x, _mm256_div_ps(x, length), nonzero);
+    y = _mm256_blendv_ps(y, _mm256_div_ps(y, length), nonzero);
+    z = _mm256_blendv_ps(z, _mm256_div_ps(z, length), nonzero);
+}
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "Vec3 arrays are read as packed floats");
+
+// 8 consecutive Vec3s, 24 floats in three registers, split into their x, y
+// and z components and merged back. Each blend picks the lanes holding one
+// component; the permutes move them into vector order and back.
+__attribute__((target("avx2")))
+static inline void loadVec3x8(const Vec3* v, __m256& x, __m256& y, __m256& z) {
+    const float* f = &v->x;
+    __m256 m0 = _mm256_loadu_ps(f), m1 = _mm256_loadu_ps(f + 8), m2 = _mm256_loadu_ps(f + 16);
+    x = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x92), m2, 0x24),
+                                 _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    y = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x24), m2, 0x49),
+                                 _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+    z = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x49), m2, 0x92),
+                                 _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+}
+
+__attribute__((target("avx2")))
+static inline void storeVec3x8(Vec3* v, __m256 x, __m256 y, __m256 z) {
+    x = _mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+    y = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(5, 0, 3, 6, 1, 4, 7, 2));
+    z = _mm256_permutevar8x32_ps(z, _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+    float* f = &v->x;
+    _mm256_storeu_ps(f, _mm256_blend_ps(_mm256_blend_ps(x, y, 0x92), z, 0x24));
+    _mm256_storeu_ps(f + 8, _mm256_blend_ps(_mm256_blend_ps(x, y, 0x24), z, 0x49));
+    _mm256_storeu_ps(f + 16, _mm256_blend_ps(_mm256_blend_ps(x, y, 0x49), z, 0x92));
+}
+
+__attribute__((target("avx2")))
+static void faceNormalBatchAVX2(const FaceCornerBatch& corners, size_t n, Vec3* out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x0 = _mm256_loadu_ps(corners.x[0] + i), y0 = _mm256_loadu_ps(corners.y[0] + i);
+        __m256 z0 = _mm256_loadu_ps(corners.z[0] + i);
+        __m256 ax = _mm256_sub_ps(_mm256_loadu_ps(corners.x[1] + i), x0);
+        __m256 ay = _mm256_sub_ps(_mm256_loadu_ps(corners.y[1] + i), y0);
+        __m256 az = _mm256_sub_ps(_mm256_loadu_ps(corners.z[1] + i), z0);
+        __m256 bx = _mm256_sub_ps(_mm256_loadu_ps(corners.x[2] + i), x0);
+        __m256 by = _mm256_sub_ps(_mm256_loadu_ps(corners.y[2] + i), y0);
+        __m256 bz = _mm256_sub_ps(_mm256_loadu_ps(corners.z[2] + i), z0);
+        __m256 x = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by));
+        __m256 y = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz));
+        __m256 z = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx));
+        normalize8(x, y, z);
+        storeVec3x8(out + i, x, y, z);
+    }
+    for (; i < n; i++) {
+        out[i] = faceNormal(corners, i);
+    }
+}
+
+__attribute__((target("avx2")))
+static void normalizeBatchAVX2(Vec3* v, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x, y, z;
+        loadVec3x8(v + i, x, y, z);
+        normalize8(x, y, z);
+        storeVec3x8(v + i, x, y, z);
+    }
+    for (; i < n; i++) {
+        normalize3(v[i]);
+    }
+}
+
+#endif
+
+bool sampleKernelUsesAVX2() {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void interpolateSamples(const TriangleMesh& mesh,
+                        const std::vector<const Texture*>& textures,
+                        const int32_t* triangles, const float* baryU, const float* baryV,
+                        size_t n, const SampleOutputs& out) {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    if (sampleKernelUsesAVX2()) {
+        interpolateSamplesAVX2(mesh, textures, triangles, baryU, baryV, n, out);
+        return;
+    }
+#endif
+    interpolateSamplesScalar(mesh, textures, triangles, baryU, baryV, n, out);
+}
+
+void sampleTextureBatch(const Texture& texture, const float* u, const float* v, size_t n, Vec3* out,
+                        TextureFilter filter, float lod) {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    // Gather offsets are 32-bit, and the 3-byte texels of every level must be complete
+    if (sampleKernelUsesAVX2() && texture.data.size() < static_cast<size_t>(INT_MAX) && !texture.data.empty()) {
+        sampleTextureBatchAVX2(texture, u, v, n, out, filter, lod);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        out[i] = sampleTextureFiltered(texture, u[i], v[i], filter, lod);
+    }
+}
+
+void sampleTexelBatch(const Texture& texture, const float* u, const float* v, size_t n, uint32_t* out) {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    bool supportedChannels = texture.channels == 1 || texture.channels >= 3;
+    if (sampleKernelUsesAVX2() && supportedChannels && texture.data.size() < static_cast<size_t>(INT_MAX) &&
+        !texture.data.empty()) {
+        sampleTexelBatchAVX2(texture, u, v, n, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        out[i] = nearestTexel(texture, u[i], v[i]);
+    }
+}
+
+void faceNormalBatch(const FaceCornerBatch& corners, size_t n, Vec3* out) {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    if (sampleKernelUsesAVX2()) {
+        faceNormalBatchAVX2(corners, n, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        out[i] = faceNormal(corners, i);
+    }
+}
+
+void normalizeBatch(Vec3* v, size_t n) {
+#ifdef OBJ2LAS_HAVE_AVX2_KERNEL
+    if (sampleKernelUsesAVX2()) {
+        normalizeBatchAVX2(v, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        normalize3(v[i]);
+    }
+}
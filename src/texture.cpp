@@ -2,12 +2,313 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <cmath>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <list>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-std::map<std::string, Texture> textureCache;
+#ifdef OBJ2LAS_HAVE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+// Region decoding needs jpeg_crop_scanline / jpeg_skip_scanlines
+#ifdef LIBJPEG_TURBO_VERSION
+#define OBJ2LAS_JPEG_REGIONS 1
+#endif
+#endif
+
+struct TextureCacheEntry {
+    TexturePtr texture;
+    std::list<std::string>::iterator lruPosition;
+};
+
+// Decoded textures by filename, with recency order for LRU eviction
+std::map<std::string, TextureCacheEntry> textureCache;
+std::list<std::string> textureLru;  // most recently used first
+size_t textureCacheBudget = 0;
+TextureCacheStats textureCacheCounters;
+std::string textureDiskCacheDirectory;
+// 2048x2048 and up: smaller images fit in cache whatever the layout
+size_t textureTilingThreshold = 2048 * 2048;
+bool textureMipmaps = false;
+std::map<std::string, TextureUvBounds> textureUvBounds;
+std::map<std::string, size_t> textureSampleCounts;
+int textureDecodeScale = 0;
+// Automatic JPEG scaling keeps at least this many texels per sample
+const double kTexelsPerSample = 4.0;
+// Guards the cache state above and keeps log lines of concurrent decodes whole
+std::mutex textureCacheMutex;
+std::mutex textureLogMutex;
+
+static size_t textureBytes(const Texture& texture) {
+    size_t bytes = texture.data.size();
+    for (const auto& level : texture.mipLevels) {
+        bytes += level->data.size();
+    }
+    return bytes;
+}
+
+// Drops least recently used entries until the cache fits its budget. The most
+// recent entry is always kept, even if it alone exceeds the budget.
+static void evictTexturesOverBudget() {
+    while (textureCacheBudget > 0 && textureCacheCounters.bytes > textureCacheBudget && textureLru.size() > 1) {
+        auto victim = textureCache.find(textureLru.back());
+        textureCacheCounters.bytes -= textureBytes(*victim->second.texture);
+        textureCache.erase(victim);
+        textureLru.pop_back();
+        textureCacheCounters.evictions++;
+    }
+}
+
+void setTextureCacheBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureCacheBudget = bytes;
+    evictTexturesOverBudget();
+}
+
+TextureCacheStats textureCacheStats() {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    return textureCacheCounters;
+}
+
+// Header of a decoded-texture disk cache file. Pixels follow at headerSize as
+// width * height * channels bytes, so the file can be mapped and used in place.
+#pragma pack(push, 1)
+struct RawTextureHeader {
+    char magic[8];
+    uint32_t headerSize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t sourceChannels;
+    uint32_t layout;
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint8_t padding[16];
+};
+#pragma pack(pop)
+static const char kRawTextureMagic[8] = {'O', '2', 'L', 'T', 'E', 'X', '0', '1'};
+
+size_t textureStorageSize(int width, int height, TextureLayout layout) {
+    if (layout == TextureLayout::RowMajor) {
+        return static_cast<size_t>(width) * height * 3;
+    }
+    Texture shape;
+    shape.width = width;
+    shape.height = height;
+    return static_cast<size_t>(shape.tilesX()) * shape.tilesY() * kTextureTileSize * kTextureTileSize * 3;
+}
+
+// Writes the texels of source to destination in the given layout
+static void copyTexelsToLayout(const Texture& source, TextureLayout layout, unsigned char* destination) {
+    Texture shape;
+    shape.width = source.width;
+    shape.height = source.height;
+    shape.layout = layout;
+    // Copy row by row; within a row, texels of one tile are contiguous in both layouts
+    for (int y = 0; y < source.height; y++) {
+        for (int x = 0; x < source.width; x += kTextureTileSize) {
+            int run = std::min(kTextureTileSize - (x & (kTextureTileSize - 1)), source.width - x);
+            std::memcpy(destination + shape.texelOffset(x, y), &source.data[source.texelOffset(x, y)], run * 3);
+        }
+    }
+}
+
+std::shared_ptr<Texture> convertTextureLayout(const Texture& source, TextureLayout layout) {
+    std::shared_ptr<Texture> converted = std::make_shared<Texture>();
+    converted->width = source.width;
+    converted->height = source.height;
+    converted->channels = source.channels;
+    converted->layout = layout;
+    converted->originX = source.originX;
+    converted->originY = source.originY;
+    converted->imageWidth = source.imageWidth;
+    converted->imageHeight = source.imageHeight;
+    converted->mipLevels = source.mipLevels;
+    converted->data.resize(textureStorageSize(source.width, source.height, layout));
+    copyTexelsToLayout(source, layout, &converted->data[0]);
+    return converted;
+}
+
+void buildMipLevels(Texture& texture) {
+    texture.mipLevels.clear();
+    const Texture* previous = &texture;
+    while (previous->width > 1 || previous->height > 1) {
+        std::shared_ptr<Texture> next = std::make_shared<Texture>();
+        next->width = std::max(1, previous->width / 2);
+        next->height = std::max(1, previous->height / 2);
+        next->channels = texture.channels;
+        next->data.resize(static_cast<size_t>(next->width) * next->height * 3);
+        for (int y = 0; y < next->height; y++) {
+            int y0 = std::min(2 * y, previous->height - 1);
+            int y1 = std::min(2 * y + 1, previous->height - 1);
+            for (int x = 0; x < next->width; x++) {
+                int x0 = std::min(2 * x, previous->width - 1);
+                int x1 = std::min(2 * x + 1, previous->width - 1);
+                size_t out = next->texelOffset(x, y);
+                for (int c = 0; c < 3; c++) {
+                    int sum = previous->data[previous->texelOffset(x0, y0) + c] + previous->data[previous->texelOffset(x1, y0) + c] +
+                              previous->data[previous->texelOffset(x0, y1) + c] + previous->data[previous->texelOffset(x1, y1) + c];
+                    next->data[out + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+        texture.mipLevels.push_back(next);
+        previous = next.get();
+    }
+}
+
+void setTextureMipmaps(bool enabled) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureMipmaps = enabled;
+}
+
+void setTextureTilingThreshold(size_t texels) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureTilingThreshold = texels;
+}
+
+void extendTextureUvBounds(TextureUvBounds& bounds, float u, float v) {
+    // Same wrapping as sampleTexture
+    u = std::fmod(u, 1.0f);
+    v = std::fmod(v, 1.0f);
+    if (u < 0) u += 1.0f;
+    if (v < 0) v += 1.0f;
+    bounds.minU = std::min(bounds.minU, u);
+    bounds.maxU = std::max(bounds.maxU, u);
+    bounds.minV = std::min(bounds.minV, v);
+    bounds.maxV = std::max(bounds.maxV, v);
+}
+
+void setTextureUvBounds(const std::map<std::string, TextureUvBounds>& bounds) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureUvBounds = bounds;
+}
+
+void setTextureSampleCounts(const std::map<std::string, size_t>& samples) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureSampleCounts = samples;
+}
+
+void setTextureDecodeScale(int denominator) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureDecodeScale = denominator;
+}
+
+bool jpegScaledDecodeAvailable() {
+#ifdef OBJ2LAS_JPEG_REGIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void setTextureDiskCache(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    textureDiskCacheDirectory = directory;
+    if (!directory.empty()) {
+        mkdir(directory.c_str(), 0755);
+    }
+}
+
+// Cache file of a source texture, named by a hash of its absolute path
+static std::string rawTexturePath(const std::string& directory, const std::string& filename) {
+    std::string key = filename;
+    char* resolved = realpath(filename.c_str(), nullptr);
+    if (resolved) {
+        key = resolved;
+        free(resolved);
+    }
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.rawtex", static_cast<unsigned long long>(hash));
+    return joinPaths(directory, name);
+}
+
+// Maps a cached texture if it was written for this exact source file
+static std::shared_ptr<Texture> mapRawTexture(const std::string& cachePath, const struct stat& source) {
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat cached;
+    RawTextureHeader header;
+    bool valid = fstat(fd, &cached) == 0 && static_cast<size_t>(cached.st_size) >= sizeof(header) &&
+                 read(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+                 std::memcmp(header.magic, kRawTextureMagic, sizeof(kRawTextureMagic)) == 0 &&
+                 header.headerSize == sizeof(header) && header.channels == 3 &&
+                 header.sourceSize == static_cast<uint64_t>(source.st_size) &&
+                 header.sourceModified == static_cast<int64_t>(source.st_mtime) &&
+                 header.layout <= static_cast<uint32_t>(TextureLayout::Tiled) &&
+                 static_cast<uint64_t>(cached.st_size) ==
+                     header.headerSize + textureStorageSize(header.width, header.height,
+                                                            static_cast<TextureLayout>(header.layout));
+    if (!valid) {
+        close(fd);
+        return nullptr;
+    }
+    size_t mappedSize = static_cast<size_t>(cached.st_size);
+    void* mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+    std::shared_ptr<const unsigned char> mapping(static_cast<const unsigned char*>(mapped),
+                                                 [mappedSize](const unsigned char* p) {
+                                                     munmap(const_cast<unsigned char*>(p), mappedSize);
+                                                 });
+    std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+    texture->width = static_cast<int>(header.width);
+    texture->height = static_cast<int>(header.height);
+    texture->channels = static_cast<int>(header.sourceChannels);
+    texture->layout = static_cast<TextureLayout>(header.layout);
+    // Aliasing pointer to the pixels that keeps the whole mapping alive
+    texture->data.adopt(std::shared_ptr<const unsigned char>(mapping, mapping.get() + header.headerSize),
+                        mappedSize - header.headerSize);
+    return texture;
+}
+
+// Writes the cache file through a temporary name so readers never see a partial file
+static void writeRawTexture(const std::string& cachePath, const struct stat& source, const Texture& texture) {
+    RawTextureHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kRawTextureMagic, sizeof(kRawTextureMagic));
+    header.headerSize = sizeof(header);
+    header.width = static_cast<uint32_t>(texture.width);
+    header.height = static_cast<uint32_t>(texture.height);
+    header.channels = 3;
+    header.sourceChannels = static_cast<uint32_t>(texture.channels);
+    header.layout = static_cast<uint32_t>(texture.layout);
+    header.sourceSize = static_cast<uint64_t>(source.st_size);
+    header.sourceModified = static_cast<int64_t>(source.st_mtime);
+
+    std::string temporaryPath = cachePath + ".tmp" + std::to_string(static_cast<long long>(getpid()));
+    std::ofstream file(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(texture.data.data()), texture.data.size());
+    file.close();
+    if (file.fail() || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        std::lock_guard<std::mutex> log(textureLogMutex);
+        std::cerr << "Failed to write texture disk cache: " << cachePath << std::endl;
+    }
+}
 template<typename T>
 T lerp(T a, T b, float t) {
     return a + t * (b - a);
@@ -32,31 +333,573 @@ bool fileExists(const std::string& filename) {
     return file.good();
 }
 
-Texture loadTexture(const std::string& filename) {
-    Texture texture;
-    if (textureCache.find(filename) != textureCache.end()) {
-        return textureCache[filename];
+// Loader settings, read once per texture so concurrent loads see a consistent set
+struct TextureLoadSettings {
+    std::string diskCacheDirectory;
+    size_t tilingThreshold;
+    bool mipmaps;
+    // UVs the file is sampled at, when known
+    bool hasUvBounds;
+    TextureUvBounds uvBounds;
+    // Points sampling the file (0 when unknown) and the forced JPEG scale
+    // denominator (0 = automatic)
+    size_t sampleCount;
+    int decodeScale;
+};
+
+static TextureLoadSettings currentTextureLoadSettings(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    TextureLoadSettings settings;
+    settings.diskCacheDirectory = textureDiskCacheDirectory;
+    settings.tilingThreshold = textureTilingThreshold;
+    settings.mipmaps = textureMipmaps;
+    auto bounds = textureUvBounds.find(filename);
+    settings.hasUvBounds = bounds != textureUvBounds.end();
+    if (settings.hasUvBounds) {
+        settings.uvBounds = bounds->second;
+    }
+    auto samples = textureSampleCounts.find(filename);
+    settings.sampleCount = samples != textureSampleCounts.end() ? samples->second : 0;
+    settings.decodeScale = textureDecodeScale;
+    return settings;
+}
+
+// Texel rectangle of an image
+struct TextureWindow {
+    int x, y, width, height;
+};
+
+// Part of a width x height image the file's UV bounds can read: the nearest
+// texels of the extreme coordinates plus one more column and row for bilinear
+// filtering. The whole image when the bounds are unknown or mip levels (which
+// are built from the whole image) are enabled.
+static TextureWindow textureWindowFor(int width, int height, const TextureLoadSettings& settings) {
+    TextureWindow window = {0, 0, width, height};
+    if (!settings.hasUvBounds || settings.uvBounds.empty() || settings.mipmaps) {
+        return window;
+    }
+    const TextureUvBounds& bounds = settings.uvBounds;
+    int x0 = std::max(0, std::min(static_cast<int>(bounds.minU * (width - 1)), width - 1));
+    int y0 = std::max(0, std::min(static_cast<int>(bounds.minV * (height - 1)), height - 1));
+    int x1 = std::max(0, std::min(static_cast<int>(bounds.maxU * (width - 1)) + 1, width - 1));
+    int y1 = std::max(0, std::min(static_cast<int>(bounds.maxV * (height - 1)) + 1, height - 1));
+    window.x = x0;
+    window.y = y0;
+    window.width = x1 - x0 + 1;
+    window.height = y1 - y0 + 1;
+    return window;
+}
+
+static bool isWholeImage(const TextureWindow& window, int width, int height) {
+    return window.x == 0 && window.y == 0 && window.width == width && window.height == height;
+}
+
+// Row-major copy of the window of a whole-image texture
+static std::shared_ptr<Texture> cropTexture(const Texture& source, const TextureWindow& window) {
+    std::shared_ptr<Texture> cropped = std::make_shared<Texture>();
+    cropped->width = window.width;
+    cropped->height = window.height;
+    cropped->channels = source.channels;
+    cropped->originX = window.x;
+    cropped->originY = window.y;
+    cropped->imageWidth = source.width;
+    cropped->imageHeight = source.height;
+    cropped->data.resize(static_cast<size_t>(window.width) * window.height * 3);
+    for (int y = 0; y < window.height; y++) {
+        for (int x = 0; x < window.width; x++) {
+            std::memcpy(&cropped->data[cropped->texelOffset(x, y)],
+                        &source.data[source.texelOffset(window.x + x, window.y + y)], 3);
+        }
+    }
+    return cropped;
+}
+
+// " (region WxH of WxH)" for textures holding part of their image
+static std::string regionNote(const Texture& texture) {
+    if (texture.imageWidth == 0) {
+        return "";
+    }
+    std::ostringstream note;
+    note << " (region " << texture.width << "x" << texture.height << " of " << texture.imageWidth << "x"
+         << texture.imageHeight << ")";
+    return note.str();
+}
+
+#ifdef OBJ2LAS_JPEG_REGIONS
+static bool isJpegFile(const std::string& filename) {
+    unsigned char magic[3] = {0, 0, 0};
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    return file.good() && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF;
+}
+
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo) {
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+static void jpegSilentMessage(j_common_ptr) {}
+
+#endif
+
+// Image size and window readTexture decodes a file to
+struct TextureDecodePlan {
+    // JPEG DCT scaling denominator, 1 for full resolution
+    int scale;
+    // Image size after scaling
+    int width, height;
+    TextureWindow window;
+};
+
+// Scaling denominator for a JPEG whose used window has this many texels at
+// full resolution: the forced one, or the largest of 8, 4 and 2 that keeps
+// kTexelsPerSample texels per sampling point
+static int jpegScaleFor(const std::string& filename, double windowTexels, const TextureLoadSettings& settings) {
+#ifdef OBJ2LAS_JPEG_REGIONS
+    if (settings.decodeScale == 1 || (settings.decodeScale == 0 && settings.sampleCount == 0) ||
+        !isJpegFile(filename)) {
+        return 1;
+    }
+    if (settings.decodeScale > 1) {
+        return settings.decodeScale;
+    }
+    for (int scale = 8; scale > 1; scale /= 2) {
+        if (windowTexels / (scale * scale) >= kTexelsPerSample * settings.sampleCount) {
+            return scale;
+        }
+    }
+#else
+    (void)filename;
+    (void)windowTexels;
+    (void)settings;
+#endif
+    return 1;
+}
+
+static TextureDecodePlan textureDecodePlan(const std::string& filename, int width, int height,
+                                           const TextureLoadSettings& settings) {
+    TextureDecodePlan plan;
+    TextureWindow fullWindow = textureWindowFor(width, height, settings);
+    plan.scale = jpegScaleFor(filename, static_cast<double>(fullWindow.width) * fullWindow.height, settings);
+    // libjpeg rounds scaled sizes up
+    plan.width = (width + plan.scale - 1) / plan.scale;
+    plan.height = (height + plan.scale - 1) / plan.scale;
+    plan.window = plan.scale == 1 ? fullWindow : textureWindowFor(plan.width, plan.height, settings);
+    return plan;
+}
+
+#ifdef OBJ2LAS_JPEG_REGIONS
+// Decodes the planned window of a JPEG as RGB, scaled in the DCT domain and
+// skipping the scanlines above and below the window and the iMCU columns
+// beside it. nullptr when libjpeg cannot decode the file (e.g. CMYK), which
+// is then left to stb_image.
+static std::shared_ptr<Texture> decodeJpegWindow(const std::string& filename, const TextureDecodePlan& plan) {
+    const TextureWindow& window = plan.window;
+    FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
+    // Everything a longjmp can skip past is either created before setjmp and
+    // left untouched, or owned by libjpeg's memory pools
+    std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager error;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = jpegErrorExit;
+    error.base.output_message = jpegSilentMessage;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        std::fclose(file);
+        return nullptr;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = static_cast<unsigned int>(plan.scale);
+    jpeg_calc_output_dimensions(&cinfo);
+    if ((cinfo.num_components != 1 && cinfo.num_components != 3) ||
+        static_cast<int>(cinfo.output_width) != plan.width || static_cast<int>(cinfo.output_height) != plan.height) {
+        jpeg_destroy_decompress(&cinfo);
+        std::fclose(file);
+        return nullptr;
+    }
+    jpeg_start_decompress(&cinfo);
+
+    // Cropping widens the columns to iMCU boundaries
+    JDIMENSION cropX = static_cast<JDIMENSION>(window.x);
+    JDIMENSION cropWidth = static_cast<JDIMENSION>(window.width);
+    if (window.width < plan.width) {
+        jpeg_crop_scanline(&cinfo, &cropX, &cropWidth);
+    }
+    if (window.y > 0) {
+        jpeg_skip_scanlines(&cinfo, static_cast<JDIMENSION>(window.y));
+    }
+    JSAMPARRAY row = (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE,
+                                               cinfo.output_width * 3, 1);
+    texture->data.resize(static_cast<size_t>(window.width) * window.height * 3);
+    size_t skip = static_cast<size_t>(window.x - static_cast<int>(cropX)) * 3;
+    for (int y = 0; y < window.height; y++) {
+        jpeg_read_scanlines(&cinfo, row, 1);
+        std::memcpy(&texture->data[static_cast<size_t>(y) * window.width * 3], row[0] + skip,
+                    static_cast<size_t>(window.width) * 3);
+    }
+    texture->channels = cinfo.num_components;
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    std::fclose(file);
+
+    texture->width = window.width;
+    texture->height = window.height;
+    if (!isWholeImage(window, plan.width, plan.height)) {
+        texture->originX = window.x;
+        texture->originY = window.y;
+        texture->imageWidth = plan.width;
+        texture->imageHeight = plan.height;
+    }
+    return texture;
+}
+#endif
+
+static bool tiledLayoutFor(int width, int height, const TextureLoadSettings& settings) {
+    return settings.tilingThreshold > 0 && static_cast<size_t>(width) * height >= settings.tilingThreshold;
+}
+
+// Source file of a texture and where its disk cache entry lives, if enabled
+struct TextureSource {
+    struct stat stat;
+    bool useDiskCache;
+    std::string cachePath;
+};
+
+static TextureSource textureSource(const std::string& filename, const TextureLoadSettings& settings) {
+    TextureSource source;
+    source.useDiskCache = !settings.diskCacheDirectory.empty() && stat(filename.c_str(), &source.stat) == 0;
+    if (source.useDiskCache) {
+        source.cachePath = rawTexturePath(settings.diskCacheDirectory, filename);
+    }
+    return source;
+}
+
+// Maps the file's disk cache entry or decodes it (row-major), restricted to
+// the window its UV bounds can reach. JPEGs with UV bounds or a reduced
+// scale go through libjpeg-turbo when available, so all region and scaled
+// decodes of a run use the same decoder; everything else goes through
+// stb_image. Turns off source.useDiskCache for scaled decodes. Logs and
+// returns nullptr when the image cannot be decoded.
+static std::shared_ptr<Texture> readTexture(const std::string& filename, TextureSource& source,
+                                            const TextureLoadSettings& settings, bool& mapped) {
+    int width = 0, height = 0, channels = 0;
+    bool known = stbi_info(filename.c_str(), &width, &height, &channels) != 0;
+    TextureDecodePlan plan = {1, width, height, {0, 0, width, height}};
+    if (known) {
+        plan = textureDecodePlan(filename, width, height, settings);
+    }
+
+    // Disk cache entries hold full-resolution images, so scaled decodes
+    // neither read nor write them
+    if (plan.scale > 1) {
+        source.useDiskCache = false;
+    }
+    std::shared_ptr<Texture> texture = source.useDiskCache ? mapRawTexture(source.cachePath, source.stat) : nullptr;
+    mapped = texture != nullptr;
+    if (mapped) {
+        {
+            std::lock_guard<std::mutex> lock(textureCacheMutex);
+            textureCacheCounters.diskHits++;
+        }
+        TextureWindow window = textureWindowFor(texture->width, texture->height, settings);
+        return isWholeImage(window, texture->width, texture->height) ? texture : cropTexture(*texture, window);
+    }
+
+#ifdef OBJ2LAS_JPEG_REGIONS
+    if (known && (settings.hasUvBounds || plan.scale > 1) && isJpegFile(filename)) {
+        texture = decodeJpegWindow(filename, plan);
+        if (texture) {
+            if (plan.scale > 1) {
+                std::lock_guard<std::mutex> log(textureLogMutex);
+                std::cout << "Decoding " << filename << " at 1/" << plan.scale << " scale (" << plan.width << "x"
+                          << plan.height << " of " << width << "x" << height << ")" << std::endl;
+            }
+            return texture;
+        }
+    }
+#endif
+    texture = std::make_shared<Texture>();
+    unsigned char* data = stbi_load(filename.c_str(), &texture->width, &texture->height, &texture->channels, 3);
+    // std::cout << "Texture channels: " << texture.channels << data << std::endl;
+    if (!data) {
+        std::lock_guard<std::mutex> log(textureLogMutex);
+        std::cerr << "Failed to load texture: " << filename << " (" << stbi_failure_reason() << ")" << std::endl;
+        return nullptr;
+    }
+    // Keep the decode buffer instead of copying it
+    texture->data.adopt(std::shared_ptr<const unsigned char>(data, [](const unsigned char* p) {
+                            stbi_image_free(const_cast<unsigned char*>(p));
+                        }),
+                        static_cast<size_t>(texture->width) * texture->height * 3);
+    TextureWindow window = textureWindowFor(texture->width, texture->height, settings);
+    if (!isWholeImage(window, texture->width, texture->height)) {
+        return cropTexture(*texture, window);
+    }
+    return texture;
+}
+
+TexturePtr loadTexture(const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> lock(textureCacheMutex);
+        auto cached = textureCache.find(filename);
+        if (cached != textureCache.end()) {
+            textureLru.splice(textureLru.begin(), textureLru, cached->second.lruPosition);
+            textureCacheCounters.hits++;
+            return cached->second.texture;
+        }
+        textureCacheCounters.misses++;
     }
 
     if (!fileExists(filename)) {
+        std::lock_guard<std::mutex> log(textureLogMutex);
         std::cerr << "Texture file not found: " << filename << std::endl;
-        return texture;
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> log(textureLogMutex);
+        std::cout << "Loading texture: " << filename << std::endl;
     }
-    std::cout << "Loading texture: " << filename << std::endl;
 
-    unsigned char* data = stbi_load(filename.c_str(), &texture.width, &texture.height, &texture.channels, 3);
-    // std::cout << "Texture channels: " << texture.channels << data << std::endl;
-    if (data) {
-        texture.data.assign(data, data + texture.width * texture.height * 3);
-        stbi_image_free(data);
-        textureCache[filename] = texture;
-        std::cout << "Texture loaded successfully: " << filename << std::endl;
-    } else {
-        std::cerr << "Failed to load texture: " << filename << std::endl;
+    TextureLoadSettings settings = currentTextureLoadSettings(filename);
+    TextureSource source = textureSource(filename, settings);
+    bool mapped = false;
+    std::shared_ptr<Texture> texture = readTexture(filename, source, settings, mapped);
+    if (!texture) {
+        return nullptr;
+    }
+    // Disk cache mappings are used in place, in whatever layout they were written
+    bool inPlace = mapped && texture->imageWidth == 0;
+    if (!inPlace && texture->layout == TextureLayout::RowMajor && tiledLayoutFor(texture->width, texture->height, settings)) {
+        texture = convertTextureLayout(*texture, TextureLayout::Tiled);
+    }
+    // Only whole images go to the disk cache, so any later window can be cut from them
+    if (!mapped && source.useDiskCache && texture->imageWidth == 0) {
+        writeRawTexture(source.cachePath, source.stat, *texture);
+    }
+    // Mip levels are cheap to rebuild and not part of the disk cache
+    if (settings.mipmaps) {
+        buildMipLevels(*texture);
     }
+    {
+        // Another thread may have decoded the same file meanwhile, keep the first copy
+        std::lock_guard<std::mutex> lock(textureCacheMutex);
+        auto inserted = textureCache.insert(std::make_pair(filename, TextureCacheEntry()));
+        if (!inserted.second) {
+            return inserted.first->second.texture;
+        }
+        textureLru.push_front(filename);
+        inserted.first->second.texture = texture;
+        inserted.first->second.lruPosition = textureLru.begin();
+        textureCacheCounters.bytes += textureBytes(*texture);
+        textureCacheCounters.peakBytes = std::max(textureCacheCounters.peakBytes, textureCacheCounters.bytes);
+        evictTexturesOverBudget();
+    }
+    std::lock_guard<std::mutex> log(textureLogMutex);
+    std::cout << (mapped ? "Texture mapped from disk cache: " : "Texture loaded successfully: ") << filename
+              << regionNote(*texture) << std::endl;
     return texture;
 }
 
+size_t decodedTextureSize(const std::string& filename) {
+    int width = 0, height = 0, channels = 0;
+    if (!stbi_info(filename.c_str(), &width, &height, &channels)) {
+        return 0;
+    }
+    // loadTexture always expands to 3 channels
+    return static_cast<size_t>(width) * height * 3;
+}
+
+// Runs task(0) ... task(count - 1) on threadCount workers (0 = one per core),
+// the calling thread included, handing out indices in order
+static void runTextureWorkers(size_t count, unsigned int threadCount, const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = static_cast<unsigned int>(std::min<size_t>(threadCount, count));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threadCount; t++) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+static std::vector<std::string> uniqueFilenames(const std::vector<std::string>& filenames) {
+    std::vector<std::string> unique(filenames);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    return unique;
+}
+
+std::map<std::string, TexturePtr> loadTexturesParallel(const std::vector<std::string>& filenames,
+                                                       unsigned int threadCount) {
+    std::vector<std::string> unique = uniqueFilenames(filenames);
+    std::vector<TexturePtr> decoded(unique.size());
+    runTextureWorkers(unique.size(), threadCount, [&](size_t i) {
+        decoded[i] = loadTexture(unique[i]);
+    });
+
+    std::map<std::string, TexturePtr> textures;
+    size_t failed = 0;
+    for (size_t i = 0; i < unique.size(); i++) {
+        if (decoded[i]) {
+            textures[unique[i]] = decoded[i];
+        } else {
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        std::cerr << failed << " of " << unique.size() << " textures could not be loaded" << std::endl;
+    }
+    return textures;
+}
+
+// Arena slots start on cache line boundaries
+static const size_t kTextureArenaAlignment = 64;
+
+// Where one texture's pixels go inside the arena: texel (x, y) is at
+// base + offset + Texture::texelOffset(x, y)
+struct TextureArenaSlot {
+    size_t offset = 0;
+    int width = 0;
+    int height = 0;
+    TextureLayout layout = TextureLayout::RowMajor;
+};
+
+std::shared_ptr<const TextureArena> loadTextureArena(const std::vector<std::string>& filenames,
+                                                     unsigned int threadCount) {
+    std::vector<std::string> unique = uniqueFilenames(filenames);
+    std::vector<TextureLoadSettings> settings;
+    for (const auto& filename : unique) {
+        settings.push_back(currentTextureLoadSettings(filename));
+    }
+
+    // Lay out every texture (or its region of interest) from its header
+    // before decoding anything
+    std::vector<TextureArenaSlot> slots(unique.size());
+    std::vector<bool> planned(unique.size(), false);
+    size_t arenaSize = 0;
+    for (size_t i = 0; i < unique.size(); i++) {
+        int width = 0, height = 0, channels = 0;
+        if (!stbi_info(unique[i].c_str(), &width, &height, &channels)) {
+            std::cerr << "Failed to load texture: " << unique[i] << " (" << stbi_failure_reason() << ")" << std::endl;
+            continue;
+        }
+        TextureWindow window = textureDecodePlan(unique[i], width, height, settings[i]).window;
+        TextureArenaSlot& slot = slots[i];
+        slot.width = window.width;
+        slot.height = window.height;
+        slot.layout = tiledLayoutFor(slot.width, slot.height, settings[i]) ? TextureLayout::Tiled : TextureLayout::RowMajor;
+        arenaSize = (arenaSize + kTextureArenaAlignment - 1) / kTextureArenaAlignment * kTextureArenaAlignment;
+        slot.offset = arenaSize;
+        arenaSize += textureStorageSize(slot.width, slot.height, slot.layout);
+        planned[i] = true;
+    }
+
+    std::shared_ptr<TextureArena> arena = std::make_shared<TextureArena>();
+    if (arenaSize == 0) {
+        return arena;
+    }
+    void* mapping = mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to allocate a " << arenaSize << " byte texture arena" << std::endl;
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    // Advisory: fewer TLB entries for lookups spread over the whole atlas
+    madvise(mapping, arenaSize, MADV_HUGEPAGE);
+#endif
+    unsigned char* base = static_cast<unsigned char*>(mapping);
+    arena->storage = std::shared_ptr<const unsigned char>(base, [arenaSize](const unsigned char* p) {
+        munmap(const_cast<unsigned char*>(p), arenaSize);
+    });
+    arena->size = arenaSize;
+
+    // Decode (or map from the disk cache) and copy into place in parallel; each
+    // decode buffer is released as soon as its pixels are in the arena
+    std::vector<std::shared_ptr<Texture> > views(unique.size());
+    runTextureWorkers(unique.size(), threadCount, [&](size_t i) {
+        if (!planned[i]) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> log(textureLogMutex);
+            std::cout << "Loading texture: " << unique[i] << std::endl;
+        }
+        TextureSource source = textureSource(unique[i], settings[i]);
+        bool mapped = false;
+        std::shared_ptr<Texture> texture = readTexture(unique[i], source, settings[i], mapped);
+        const TextureArenaSlot& slot = slots[i];
+        if (!texture) {
+            return;
+        }
+        if (texture->width != slot.width || texture->height != slot.height) {
+            std::lock_guard<std::mutex> log(textureLogMutex);
+            std::cerr << "Failed to load texture: " << unique[i] << " (decoded " << texture->width << "x"
+                      << texture->height << ", header said " << slot.width << "x" << slot.height << ")" << std::endl;
+            return;
+        }
+        copyTexelsToLayout(*texture, slot.layout, base + slot.offset);
+
+        std::shared_ptr<Texture> view = std::make_shared<Texture>();
+        view->width = slot.width;
+        view->height = slot.height;
+        view->channels = texture->channels;
+        view->layout = slot.layout;
+        view->originX = texture->originX;
+        view->originY = texture->originY;
+        view->imageWidth = texture->imageWidth;
+        view->imageHeight = texture->imageHeight;
+        view->data.adopt(std::shared_ptr<const unsigned char>(arena->storage, base + slot.offset),
+                         textureStorageSize(slot.width, slot.height, slot.layout));
+        texture.reset();
+        if (!mapped && source.useDiskCache && view->imageWidth == 0) {
+            writeRawTexture(source.cachePath, source.stat, *view);
+        }
+        if (settings[i].mipmaps) {
+            buildMipLevels(*view);
+        }
+        views[i] = view;
+        std::lock_guard<std::mutex> log(textureLogMutex);
+        std::cout << (mapped ? "Texture mapped from disk cache: " : "Texture loaded successfully: ") << unique[i]
+                  << regionNote(*view) << std::endl;
+    });
+
+    size_t failed = 0;
+    for (size_t i = 0; i < unique.size(); i++) {
+        if (!views[i]) {
+            failed++;
+            continue;
+        }
+        arena->textures[unique[i]] = views[i];
+    }
+    if (failed > 0) {
+        std::cerr << failed << " of " << unique.size() << " textures could not be loaded" << std::endl;
+    }
+    return arena;
+}
+
 // Vec3 sampleTexture(const Texture& texture, float u, float v) {
 //     if (texture.data.empty()) {
 //         return Vec3();
@@ -76,7 +919,8 @@ Texture loadTexture(const std::string& filename) {
 //     );
 // }
 
-Vec3 sampleTexture(const Texture& texture, float u, float v) {
+// Byte offset of the texel sampleTexture reads at (u, v)
+static size_t nearestTexelOffset(const Texture& texture, float u, float v) {
     // Ensure u and v are in [0, 1] range
     u = std::fmod(u, 1.0f);
     v = std::fmod(v, 1.0f);
@@ -84,16 +928,28 @@ Vec3 sampleTexture(const Texture& texture, float u, float v) {
     if (v < 0) v += 1.0f;
 
     // Convert to pixel coordinates
-    int x = static_cast<int>(u * (texture.width - 1));
-    int y = static_cast<int>(v * (texture.height - 1));
+    int x = static_cast<int>(u * (texture.uvWidth() - 1));
+    int y = static_cast<int>(v * (texture.uvHeight() - 1));
 
     // Ensure x and y are within bounds
-    x = std::max(0, std::min(x, texture.width - 1));
-    y = std::max(0, std::min(y, texture.height - 1));
+    x = texture.storedX(x);
+    y = texture.storedY(y);
 
-    // Calculate the index in the image data array
-    int index = (y * texture.width + x) * texture.channels;
-    
+    // Calculate the index in the image data array (always 3 bytes per texel)
+    return texture.texelOffset(x, y);
+}
+
+uint32_t nearestTexel(const Texture& texture, float u, float v) {
+    if (texture.channels < 1 || texture.channels == 2) {
+        return 0;
+    }
+    size_t index = nearestTexelOffset(texture, u, v);
+    return static_cast<uint32_t>(texture.data[index]) | (static_cast<uint32_t>(texture.data[index + 1]) << 8) |
+           (static_cast<uint32_t>(texture.data[index + 2]) << 16);
+}
+
+Vec3 sampleTexture(const Texture& texture, float u, float v) {
+    size_t index = nearestTexelOffset(texture, u, v);
 
     // Sample the color
     Vec3 color;
@@ -208,8 +1064,66 @@ Vec3 sampleTexture(const Texture& texture, float u, float v) {
     }
     return color;
 }
-std::map<std::string, Texture> loadTextures(const std::string& mtlFilename) {
-    std::map<std::string, Texture> textures;
+
+// Bilinear blend of the four texels around (su, sv) in [0, 1)
+static Vec3 bilinearTexel(const Texture& level, float su, float sv) {
+    float fx = su * static_cast<float>(level.uvWidth() - 1);
+    float fy = sv * static_cast<float>(level.uvHeight() - 1);
+    int x0 = std::max(0, std::min(static_cast<int>(fx), level.uvWidth() - 1));
+    int y0 = std::max(0, std::min(static_cast<int>(fy), level.uvHeight() - 1));
+    int x1 = std::min(x0 + 1, level.uvWidth() - 1);
+    int y1 = std::min(y0 + 1, level.uvHeight() - 1);
+    float tx = fx - static_cast<float>(x0);
+    float ty = fy - static_cast<float>(y0);
+    x0 = level.storedX(x0);
+    x1 = level.storedX(x1);
+    y0 = level.storedY(y0);
+    y1 = level.storedY(y1);
+
+    const unsigned char* c00 = &level.data[level.texelOffset(x0, y0)];
+    const unsigned char* c10 = &level.data[level.texelOffset(x1, y0)];
+    const unsigned char* c01 = &level.data[level.texelOffset(x0, y1)];
+    const unsigned char* c11 = &level.data[level.texelOffset(x1, y1)];
+    float channel[3];
+    for (int c = 0; c < 3; c++) {
+        float top = static_cast<float>(c00[c]) + (static_cast<float>(c10[c]) - static_cast<float>(c00[c])) * tx;
+        float bottom = static_cast<float>(c01[c]) + (static_cast<float>(c11[c]) - static_cast<float>(c01[c])) * tx;
+        channel[c] = top + (bottom - top) * ty;
+    }
+    return Vec3(channel[0], channel[1], channel[2]);
+}
+
+Vec3 sampleTextureFiltered(const Texture& texture, float u, float v, TextureFilter filter, float lod) {
+    if (filter == TextureFilter::Nearest) {
+        return sampleTexture(texture, u, v);
+    }
+    float su = u - std::floor(u);
+    float sv = v - std::floor(v);
+
+    Vec3 color;
+    int maxLevel = texture.levelCount() - 1;
+    if (filter == TextureFilter::Bilinear || lod <= 0.0f || maxLevel == 0) {
+        color = bilinearTexel(texture, su, sv);
+    } else {
+        lod = std::min(lod, static_cast<float>(maxLevel));
+        int coarse = static_cast<int>(lod);
+        float blend = lod - static_cast<float>(coarse);
+        Vec3 a = bilinearTexel(texture.level(coarse), su, sv);
+        Vec3 b = coarse < maxLevel ? bilinearTexel(texture.level(coarse + 1), su, sv) : a;
+        color = Vec3(a.x + (b.x - a.x) * blend, a.y + (b.y - a.y) * blend, a.z + (b.z - a.z) * blend);
+    }
+
+    // Same brightness boost as sampleTexture
+    if (color.x < 200 && color.y < 200 && color.z < 200) {
+        color.x *= 1.15f;
+        color.y *= 1.15f;
+        color.z *= 1.15f;
+    }
+    return color;
+}
+
+std::map<std::string, TexturePtr> loadTextures(const std::string& mtlFilename) {
+    std::map<std::string, TexturePtr> textures;
     std::ifstream mtlFile(mtlFilename);
     if (!mtlFile.is_open()) {
         std::cerr << "Failed to open MTL file: " << mtlFilename << std::endl;
@@ -232,8 +1146,11 @@ std::map<std::string, Texture> loadTextures(const std::string& mtlFilename) {
             std::string fullPath = joinPaths(mtlDir, textureFilename);
             
             if (fileExists(fullPath)) {
-                textures[currentMaterial] = loadTexture(fullPath);
-                std::cout << "Loaded texture: " << fullPath << std::endl;
+                TexturePtr texture = loadTexture(fullPath);
+                if (texture) {
+                    textures[currentMaterial] = texture;
+                    std::cout << "Loaded texture: " << fullPath << std::endl;
+                }
             } else {
                 std::cerr << "Texture file not found: " << fullPath << std::endl;
             }